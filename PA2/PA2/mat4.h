@@ -0,0 +1,280 @@
+#ifndef _MAT4_H_
+#define _MAT4_H_
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+#if defined( __AVX__ )
+#define MAT4_AVX
+#include <immintrin.h>
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define MAT4_SSE2
+#include <emmintrin.h>
+#endif
+
+// 4x4 double matrix stored column-major, like OpenGL: m[12], m[13], m[14] is
+// the translation, and m can be handed to glLoadMatrixd/glMultMatrixd as is.
+// Products use AVX or SSE2 when the compiler targets them, scalar code otherwise.
+// Loads are unaligned, so mat4_t needs no special allocator in std::vector.
+// Nothing here needs a GL context.
+struct mat4_t {
+	using double3 = std::array<double, 3>;
+
+	double m[16];
+
+	// identity
+	constexpr mat4_t()
+		: m{ 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 } {}
+
+	// Entries in column-major order, as they are laid out in memory.
+	constexpr mat4_t( double m0, double m1, double m2, double m3,
+	                  double m4, double m5, double m6, double m7,
+	                  double m8, double m9, double m10, double m11,
+	                  double m12, double m13, double m14, double m15 )
+		: m{ m0, m1, m2, m3, m4, m5, m6, m7, m8, m9, m10, m11, m12, m13, m14, m15 } {}
+
+	static constexpr mat4_t zero() {
+		return mat4_t( 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
+	}
+
+	static constexpr mat4_t translation( double x, double y, double z ) {
+		return mat4_t( 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, x, y, z, 1 );
+	}
+
+	static constexpr mat4_t scaling( double x, double y, double z ) {
+		return mat4_t( x, 0, 0, 0, 0, y, 0, 0, 0, 0, z, 0, 0, 0, 0, 1 );
+	}
+
+	// Rotation by angle degrees about axis (x, y, z), as glRotated.
+	static mat4_t rotation( double angle, double x, double y, double z ) {
+		double l = std::sqrt( x * x + y * y + z * z );
+		if ( l == 0 )
+			return mat4_t();
+		x /= l;
+		y /= l;
+		z /= l;
+		double a = angle * 3.14159265358979323846 / 180;
+		double c = std::cos( a ), s = std::sin( a ), t = 1 - c;
+		return mat4_t( t * x * x + c,     t * x * y + s * z, t * x * z - s * y, 0,
+		               t * x * y - s * z, t * y * y + c,     t * y * z + s * x, 0,
+		               t * x * z + s * y, t * y * z - s * x, t * z * z + c,     0,
+		               0,                 0,                 0,                 1 );
+	}
+
+	// World-to-eye matrix of a viewer at eye looking at center, as gluLookAt.
+	static mat4_t look_at( const double3 &eye, const double3 &center, const double3 &up ) {
+		double3 f{ center[0] - eye[0], center[1] - eye[1], center[2] - eye[2] };
+		f = normalize( f );
+		double3 s = normalize( cross( f, up ) );
+		double3 u = cross( s, f );
+		return mat4_t( s[0], u[0], -f[0], 0,
+		               s[1], u[1], -f[1], 0,
+		               s[2], u[2], -f[2], 0,
+		               -dot( s, eye ), -dot( u, eye ), dot( f, eye ), 1 );
+	}
+
+	// Copy of a column-major double[16], e.g. from glGetDoublev.
+	static mat4_t from( const double *column_major ) {
+		mat4_t r;
+		for ( int i = 0; i < 16; ++i )
+			r.m[i] = column_major[i];
+		return r;
+	}
+
+	double &operator()( int row, int column ) {
+		return m[column * 4 + row];
+	}
+
+	constexpr double operator()( int row, int column ) const {
+		return m[column * 4 + row];
+	}
+
+	bool is_affine() const {
+		return m[3] == 0 && m[7] == 0 && m[11] == 0 && m[15] == 1;
+	}
+
+	// Column j of the product is this matrix applied to column j of b.
+	mat4_t operator*( const mat4_t &b ) const {
+		mat4_t r = zero();
+#if defined( MAT4_AVX )
+		__m256d c0 = _mm256_loadu_pd( m ), c1 = _mm256_loadu_pd( m + 4 );
+		__m256d c2 = _mm256_loadu_pd( m + 8 ), c3 = _mm256_loadu_pd( m + 12 );
+		for ( int j = 0; j < 4; ++j ) {
+			const double *bj = b.m + 4 * j;
+			__m256d s = _mm256_mul_pd( c0, _mm256_broadcast_sd( bj ) );
+			s = _mm256_add_pd( s, _mm256_mul_pd( c1, _mm256_broadcast_sd( bj + 1 ) ) );
+			s = _mm256_add_pd( s, _mm256_mul_pd( c2, _mm256_broadcast_sd( bj + 2 ) ) );
+			s = _mm256_add_pd( s, _mm256_mul_pd( c3, _mm256_broadcast_sd( bj + 3 ) ) );
+			_mm256_storeu_pd( r.m + 4 * j, s );
+		}
+#elif defined( MAT4_SSE2 )
+		for ( int j = 0; j < 4; ++j ) {
+			const double *bj = b.m + 4 * j;
+			__m128d lo = _mm_setzero_pd(), hi = _mm_setzero_pd();
+			for ( int k = 0; k < 4; ++k ) {
+				__m128d s = _mm_set1_pd( bj[k] );
+				lo = _mm_add_pd( lo, _mm_mul_pd( _mm_loadu_pd( m + 4 * k ), s ) );
+				hi = _mm_add_pd( hi, _mm_mul_pd( _mm_loadu_pd( m + 4 * k + 2 ), s ) );
+			}
+			_mm_storeu_pd( r.m + 4 * j, lo );
+			_mm_storeu_pd( r.m + 4 * j + 2, hi );
+		}
+#else
+		for ( int j = 0; j < 4; ++j ) {
+			for ( int k = 0; k < 4; ++k ) {
+				for ( int i = 0; i < 4; ++i )
+					r.m[4 * j + i] += m[4 * k + i] * b.m[4 * j + k];
+			}
+		}
+#endif
+		return r;
+	}
+
+	mat4_t &operator*=( const mat4_t &b ) {
+		return *this = *this * b;
+	}
+
+	// Point (w = 1), ignoring the projective row.
+	double3 transform_point( const double3 &p ) const {
+		return double3{
+			m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12],
+			m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13],
+			m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14]
+		};
+	}
+
+	// Direction (w = 0): no translation.
+	double3 transform_vector( const double3 &v ) const {
+		return double3{
+			m[0] * v[0] + m[4] * v[1] + m[8] * v[2],
+			m[1] * v[0] + m[5] * v[1] + m[9] * v[2],
+			m[2] * v[0] + m[6] * v[1] + m[10] * v[2]
+		};
+	}
+
+	// transform_point over count points; in and out may be the same array.
+	void transform_points( const double3 *in, double3 *out, std::size_t count ) const {
+#if defined( MAT4_AVX )
+		__m256d c0 = _mm256_loadu_pd( m ), c1 = _mm256_loadu_pd( m + 4 );
+		__m256d c2 = _mm256_loadu_pd( m + 8 ), c3 = _mm256_loadu_pd( m + 12 );
+		for ( std::size_t i = 0; i < count; ++i ) {
+			__m256d s = _mm256_add_pd( c3, _mm256_mul_pd( c0, _mm256_set1_pd( in[i][0] ) ) );
+			s = _mm256_add_pd( s, _mm256_mul_pd( c1, _mm256_set1_pd( in[i][1] ) ) );
+			s = _mm256_add_pd( s, _mm256_mul_pd( c2, _mm256_set1_pd( in[i][2] ) ) );
+			alignas( 32 ) double r[4];
+			_mm256_store_pd( r, s );
+			out[i] = double3{ r[0], r[1], r[2] };
+		}
+#elif defined( MAT4_SSE2 )
+		for ( std::size_t i = 0; i < count; ++i ) {
+			__m128d x = _mm_set1_pd( in[i][0] ), y = _mm_set1_pd( in[i][1] ), z = _mm_set1_pd( in[i][2] );
+			__m128d xy = _mm_add_pd( _mm_loadu_pd( m + 12 ), _mm_mul_pd( _mm_loadu_pd( m ), x ) );
+			xy = _mm_add_pd( xy, _mm_mul_pd( _mm_loadu_pd( m + 4 ), y ) );
+			xy = _mm_add_pd( xy, _mm_mul_pd( _mm_loadu_pd( m + 8 ), z ) );
+			double pz = m[2] * in[i][0] + m[6] * in[i][1] + m[10] * in[i][2] + m[14];
+			alignas( 16 ) double r[2];
+			_mm_store_pd( r, xy );
+			out[i] = double3{ r[0], r[1], pz };
+		}
+#else
+		for ( std::size_t i = 0; i < count; ++i )
+			out[i] = transform_point( in[i] );
+#endif
+	}
+
+	static double dot( const double3 &a, const double3 &b ) {
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	static double3 cross( const double3 &a, const double3 &b ) {
+		return double3{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+	}
+
+	static double3 normalize( const double3 &v ) {
+		double l = std::sqrt( dot( v, v ) );
+		return l == 0 ? v : double3{ v[0] / l, v[1] / l, v[2] / l };
+	}
+
+	mat4_t transpose() const {
+		return mat4_t( m[0], m[4], m[8], m[12], m[1], m[5], m[9], m[13],
+		               m[2], m[6], m[10], m[14], m[3], m[7], m[11], m[15] );
+	}
+
+	// Inverse of an affine matrix (rotation, scale and shear plus translation).
+	// Returns false and leaves out alone if it is singular.
+	bool invert_affine( mat4_t &out ) const {
+		double i11 = m[5] * m[10] - m[6] * m[9];
+		double i21 = m[6] * m[8] - m[4] * m[10];
+		double i31 = m[4] * m[9] - m[5] * m[8];
+		double det = i11 * m[0] + i21 * m[1] + i31 * m[2];
+		if ( det == 0 )
+			return false;
+		det = 1 / det;
+
+		double i12 = m[2] * m[9] - m[1] * m[10];
+		double i22 = m[0] * m[10] - m[2] * m[8];
+		double i32 = m[1] * m[8] - m[0] * m[9];
+		double i13 = m[1] * m[6] - m[2] * m[5];
+		double i23 = m[2] * m[4] - m[0] * m[6];
+		double i33 = m[0] * m[5] - m[1] * m[4];
+
+		double i41 = -( i11 * m[12] + i21 * m[13] + i31 * m[14] );
+		double i42 = -( i12 * m[12] + i22 * m[13] + i32 * m[14] );
+		double i43 = -( i13 * m[12] + i23 * m[13] + i33 * m[14] );
+
+		out = mat4_t( det * i11, det * i12, det * i13, 0,
+		              det * i21, det * i22, det * i23, 0,
+		              det * i31, det * i32, det * i33, 0,
+		              det * i41, det * i42, det * i43, 1 );
+		return true;
+	}
+
+	// General inverse by cofactors, for projective matrices too.
+	// Returns false and leaves out alone if it is singular.
+	bool invert( mat4_t &out ) const {
+		// 2x2 minors of the top two and the bottom two rows
+		double s0 = m[0] * m[5] - m[4] * m[1];
+		double s1 = m[0] * m[9] - m[8] * m[1];
+		double s2 = m[0] * m[13] - m[12] * m[1];
+		double s3 = m[4] * m[9] - m[8] * m[5];
+		double s4 = m[4] * m[13] - m[12] * m[5];
+		double s5 = m[8] * m[13] - m[12] * m[9];
+		double c5 = m[10] * m[15] - m[14] * m[11];
+		double c4 = m[6] * m[15] - m[14] * m[7];
+		double c3 = m[6] * m[11] - m[10] * m[7];
+		double c2 = m[2] * m[15] - m[14] * m[3];
+		double c1 = m[2] * m[11] - m[10] * m[3];
+		double c0 = m[2] * m[7] - m[6] * m[3];
+
+		double det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+		if ( det == 0 )
+			return false;
+		double d = 1 / det;
+
+		mat4_t r;
+		r( 0, 0 ) = ( m[5] * c5 - m[9] * c4 + m[13] * c3 ) * d;
+		r( 0, 1 ) = ( -m[4] * c5 + m[8] * c4 - m[12] * c3 ) * d;
+		r( 0, 2 ) = ( m[7] * s5 - m[11] * s4 + m[15] * s3 ) * d;
+		r( 0, 3 ) = ( -m[6] * s5 + m[10] * s4 - m[14] * s3 ) * d;
+
+		r( 1, 0 ) = ( -m[1] * c5 + m[9] * c2 - m[13] * c1 ) * d;
+		r( 1, 1 ) = ( m[0] * c5 - m[8] * c2 + m[12] * c1 ) * d;
+		r( 1, 2 ) = ( -m[3] * s5 + m[11] * s2 - m[15] * s1 ) * d;
+		r( 1, 3 ) = ( m[2] * s5 - m[10] * s2 + m[14] * s1 ) * d;
+
+		r( 2, 0 ) = ( m[1] * c4 - m[5] * c2 + m[13] * c0 ) * d;
+		r( 2, 1 ) = ( -m[0] * c4 + m[4] * c2 - m[12] * c0 ) * d;
+		r( 2, 2 ) = ( m[3] * s4 - m[7] * s2 + m[15] * s0 ) * d;
+		r( 2, 3 ) = ( -m[2] * s4 + m[6] * s2 - m[14] * s0 ) * d;
+
+		r( 3, 0 ) = ( -m[1] * c3 + m[5] * c1 - m[9] * c0 ) * d;
+		r( 3, 1 ) = ( m[0] * c3 - m[4] * c1 + m[8] * c0 ) * d;
+		r( 3, 2 ) = ( -m[3] * s3 + m[7] * s1 - m[11] * s0 ) * d;
+		r( 3, 3 ) = ( m[2] * s3 - m[6] * s1 + m[10] * s0 ) * d;
+		out = r;
+		return true;
+	}
+};
+
+#endif // _MAT4_H_
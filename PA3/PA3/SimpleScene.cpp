@@ -1,11 +1,33 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <string>
 #include <vector>
 #include <array>
 #include <cmath>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
 #include <GL/glut.h>
 #include "FrameXform.h"
+#include "rigid_xform.h"
+#include "scene_graph.h"
+#include "scene_pick.h"
 #include "wavefront_obj.h"
+#include "mesh_lod.h"
+#include "mesh_bvh.h"
+#include "mesh_cluster.h"
+#include "mesh_buffer.h"
+#include "gl_mesh.h"
+#include "anim_scheduler.h"
+#include "soft_raster.h"
+#include "input_log.h"
+#include "texture_gen.h"
+#include "ground_tiles.h"
+#include "camera_path.h"
+#include "asset_cache.h"
+#include "scene_file.h"
 
 using double2 = std::array<double, 2>;
 using double3 = std::array<double, 3>;
@@ -14,28 +36,79 @@ using double3 = std::array<double, 3>;
 template<typename T>
 T const PI = std::acos( -T( 1 ) );
 
-// 'cameras' stores infomation of 5 cameras.
-std::vector<std::array<double, 9>> cameras{
-    {28, 18, 28, 0, 2, 0, 0, 1, 0},
-    {28, 18, -28, 0, 2, 0, 0, 1, 0},
-    {-28, 18, 28, 0, 2, 0, 0, 1, 0},
-    {-12, 12, 0, 0, 2, 0, 0, 1, 0},
-    {0, 100, 0,  0, 0, 0, 1, 0, 0}
-};
-
-int cameraIndex, camID;
-std::vector<FrameXform> wld2cam, cam2wld;
-wavefront_obj_t *cam;
+// The meshes, cameras, cow and lights come from a scene file; see scene_file.h.
+const char *scenePath = "scene.txt";    // --scene picks another.
+scene_file_t *sceneFile;                // read in main().
+int cowInstance;                        // the instance of sceneFile that the mouse and keyboard move.
+
+// Every mesh of the scene, loaded once and shared. main() starts reading them all at
+// once, from their binary caches when those are up to date. --no-mesh-cache reads
+// the .obj files at full precision every time and writes no caches.
+bool meshCache = true;
+asset_cache_t<wavefront_obj_t> assets( std::size_t( 256 ) << 20, std::max( 2u, std::thread::hardware_concurrency() ),
+                                       []( const std::string &key ) { return load_scene_mesh( key, meshCache ); } );
+
+int cameraIndex;
+scene_graph_t scene;            // Every object's transform. Cameras and the cow are roots; a camera's model hangs below its frame.
+std::vector<int> camNodes;      // cam2wld of each camera.
+std::vector<int> camModelNodes; // the half-size camera model drawn in front of each camera frame.
+asset_cache_t<wavefront_obj_t>::handle_t cam;
+mesh_bvh_t *camBvh;             // face hierarchy of the camera model, for picking and culling.
+mesh_lod_t *camLod;             // levels of detail of the camera model.
+const int lodReferenceHeight = 600;         // window height camLod's switching sizes are given for; others scale to it.
+std::vector<mesh_buffer_t *> camBuffers;    // welded triangles of each level; camBuffers[0] is the full camera.
+std::vector<gl_mesh_t *> camMeshes;         // each level uploaded to vertex and index buffers.
+std::vector<std::vector<gl_mesh_t::instance_t>> camInstances;  // visible cameras of each level this frame, drawn together.
 
 // Variables for 'cow' object.
-FrameXform cow2wld;
-wavefront_obj_t *cow;
-int cowID;
+int cowNode = scene_graph_t::none;      // cow2wld.
+asset_cache_t<wavefront_obj_t>::handle_t cow;
+mesh_bvh_t *cowBvh;
+mesh_buffer_t *cowBuffer;
+gl_mesh_t *cowMesh;
+mesh_cluster_t *cowClusters;    // the cow split into meshlets, each compiled into a display list.
+std::vector<int> cowClusterIDs;
+bool drawClusters = false;      // 'k' toggles drawing the cow cluster by cluster, skipping back-facing ones.
+
+// Scenery: every other instance of the scene file. It is drawn, but neither picked nor moved.
+std::vector<int> sceneryInstances;                  // index into sceneFile->instances.
+std::vector<int> sceneryNodes;                      // inst2wld of each.
+std::vector<asset_cache_t<wavefront_obj_t>::handle_t> sceneryMeshes;   // per mesh of sceneFile; empty if no scenery uses it.
+std::vector<mesh_buffer_t *> sceneryBuffers;        // per mesh, welded and triangulated.
+std::vector<gl_mesh_t *> sceneryGlMeshes;           // per mesh, uploaded.
+std::vector<std::vector<gl_mesh_t::instance_t>> sceneryDraws;  // visible instances of each mesh this frame.
 
 unsigned floorTexID;
+std::future<mip_texture_t> floorTextureJob;    // the full-size, mipmapped floor texture, while it is generated.
+const int floorTextureSize = 2048;
+ground_tiles_t ground( 2048, -0.2, 16 );       // the ground around the floor, in tiles from 16 units up to 4096.
+gl_mesh_t *groundMesh;                          // the unit tile every ground tile is drawn with.
+std::vector<ground_tiles_t::tile_t> groundTiles;   // the tiles in view this frame, set by selectGround().
+int lastGroundTiles = -1;
 int frame = 0;
 int width, height;
-int selectMode, oldX, oldY;
+const double fovy = 45;         // vertical field of view of the projection set in reshape().
+const double zNear = 1, zFar = 1024;
+std::vector<mesh_bvh_t::plane_t> viewPlanes;    // the view frustum in world space, set in setCamera() for culling.
+int culledCount, lastCulledCount = -1;          // objects not drawn because they were out of view, this frame and the last reported.
+int oldX, oldY;
+int dragButton = -1;            // mouse button held down, or -1.
+bool dragPending = false;       // the cursor moved since the last frame; applyDrag() catches up once.
+int dragX, dragY, dragEvents;   // the latest cursor position of the drag, and how many motion events led there.
+bool lassoSelect;               // the right-button drag draws a lasso (with shift) rather than a box.
+std::vector<screen_point_t> selectOutline;  // box corners or lasso points of the right-button drag, y up.
+
+// Recording and replaying input, for timing interaction.
+input_recorder_t *inputRecorder;        // with --record, every input event is appended to its log.
+input_log_t replayLog;                  // with --replay, events fed to the handlers at their recorded times.
+std::size_t replayNext;                 // the next event of replayLog to feed.
+const input_event_t *replayEvent;       // the event being fed; its modifiers stand in for glutGetModifiers().
+input_latency_t replayLatency;          // from each replayed event to the frame that shows it.
+std::chrono::steady_clock::time_point replayStart;
+bool headless = false;                  // drawing in software without a window, so GLUT must not be called.
+bool redisplayPending;                  // the headless stand-in for glutPostRedisplay().
+bool verbose = false;                   // --verbose prints per-frame diagnostics, which cost time of their own.
+std::chrono::steady_clock::time_point headlessNow;  // the simulated time of the headless frame being made.
 
 // (Project 2, 3) Variables
 /*****************************/
@@ -51,74 +124,172 @@ double rotz = 0;
 
 char transMode = 'm';           //m : modeling space, v : viewing space
 
-void spinCow(void);
+anim_scheduler_t animator;      // steps animations at 120 Hz and paces their frames at 60 Hz.
+bool animationTimerSet = false;
+int spinTask = -1;              // the animator's id for spinCow, while it runs.
+const double spinSpeed = 6;     // degrees per second; the old 0.1 degree per frame at 60 frames per second.
+
+// Flythrough: 'f' flies a smooth loop through every camera instead of jumping between them.
+int flyNode = scene_graph_t::none;      // the flying camera, viewed from instead of cameraIndex while flying.
+bool flying = false;
+std::vector<rigid_xform_t> flyPoses;    // the whole loop, precomputed with one pose per animation step.
+std::size_t flyFrame;
+int flyTask = -1;                       // the animator's id for flyStep, while flying.
+const double flySeconds = 4;            // time from one camera to the next.
+
+void spinCow( double dt );
+void flyStep( double dt );
+std::vector<rigid_xform_t> flythroughPath( int count );
+void startAnimationTimer();
 /*****************************/
 
+// The node the scene is viewed from: the current camera, or the flying one.
+int viewNode() {
+    return flying ? flyNode : camNodes[cameraIndex];
+}
+
+// Camera i is neither drawn nor picked when it is the viewer, or when the
+// flying viewer passes so close that its model would fill the view.
+bool hiddenCamera( int i ) {
+    if ( !flying )
+        return i == cameraIndex;
+    const mat4_t &camera = scene.world( camNodes[i] ), &viewer = scene.world( flyNode );
+    double d2 = 0;
+    for ( int k = 12; k < 15; k++ )
+        d2 += ( camera.m[k] - viewer.m[k] ) * ( camera.m[k] - viewer.m[k] );
+    return d2 < 2 * 2;
+}
+
+// Request a redraw, from GLUT or from the headless replay loop.
+void postRedisplay() {
+    if ( headless )
+        redisplayPending = true;
+    else
+        glutPostRedisplay();
+}
+
+// glutGetModifiers() of the event being handled, live or replayed.
+int eventModifiers() {
+    return replayEvent ? replayEvent->modifiers : glutGetModifiers();
+}
+
+// The time animations run by: the replayed clock when headless, otherwise real time.
+anim_scheduler_t::clock_type::time_point animationNow() {
+    return headless ? headlessNow : anim_scheduler_t::clock_type::now();
+}
+
 void drawFrame( float len );
+void applyDrag();
+bool frameInView( const mat4_t &frame, float len );
+
+// Location and direction of the cow.
+const rigid_xform_t &cowPose() {
+    return scene.local( cowNode );
+}
 
-double3 munge( int x ) {
-    double r, g, b;
-    r = ( x & 255 ) / double( 255 );
-    g = ( ( x >> 8 ) & 255 ) / double( 255 );
-    b = ( ( x >> 16 ) & 255 ) / double( 255 );
-    return double3{ r, g, b };
+void setCowPose( const rigid_xform_t &pose ) {
+    scene.set_local( cowNode, pose );
 }
 
-int unmunge( double3 color ) {
-    double r = color[0], g = color[1], b = color[2];
-    return ( int( r ) + ( int( g ) << 8 ) + ( int( b ) << 16 ) );
+/*********************************************************************************
+* Mesh m of the scene file, smoothed if the scene file asks for it. Waits for
+* main() to finish reading it. A mesh that cannot be read ends the program,
+* since the scene cannot be shown without it.
+**********************************************************************************/
+asset_cache_t<wavefront_obj_t>::handle_t loadSceneMesh( int m ) {
+    const scene_file_t::mesh_t &desc = sceneFile->meshes[m];
+    try {
+        return assets.load( desc.asset_key() );
+    } catch ( std::runtime_error &error ) {
+        fprintf( stderr, "%s: %s\n", desc.path.c_str(), error.what() );
+        exit( 1 );
+    }
+}
+
+/*********************************************************************************
+* Load the camera model and place the cameras. Nothing here calls GL, so the
+* headless renderer shares it with setCamera().
+**********************************************************************************/
+void loadCameras() {
+    unsigned int i;
+    // intialize camera model.
+    cam = loadSceneMesh( sceneFile->camera_mesh );
+    cam->print_load_stats( std::cout, sceneFile->meshes[sceneFile->camera_mesh].path.c_str() );
+    camBvh = new mesh_bvh_t( *cam );
+    camBuffers.push_back( new mesh_buffer_t( *cam ) );         // Weld and triangulate the camera.
+
+    // Build simplified cameras for drawing far away.
+    camLod = new mesh_lod_t( *cam, { 0.5, 0.2, 0.05 }, lodReferenceHeight );
+    for ( i = 1; i < camLod->levels.size(); i++ )
+        camBuffers.push_back( new mesh_buffer_t( *camLod->levels[i].mesh ) );
+
+    // initialize camera frame transforms.
+    rigid_xform_t model = sceneFile->camera_model.resolve( cam->aabb );   // the camera model in each camera's frame.
+    for ( i = 0; i < sceneFile->cameras.size(); i++ ) {
+        auto &camera = sceneFile->cameras[i];
+        FrameXform wld2cam = mat4_t::look_at( camera.eye, camera.center, camera.up );  // The world-to-camera matrix, as gluLookAt would make it.
+        camNodes.push_back( scene.add_node( scene_graph_t::none, rigid_xform_t::from_mat4( wld2cam.inverse() ), "camera" ) );
+        camModelNodes.push_back( scene.add_node( camNodes[i], model, "camera model" ) );
+    }
+    cameraIndex = 0;
+    flyNode = scene.add_node( scene_graph_t::none, rigid_xform_t(), "flythrough camera" );
+}
+
+/*********************************************************************************
+* Level of detail to draw camera i with, from the projected size of its bounding
+* box. modelView is the camera model's frame in the viewer's frame.
+**********************************************************************************/
+std::size_t camLevel( int i, const mat4_t &modelView ) {
+    double3 center;
+    for ( int k = 0; k < 3; k++ )
+        center[k] = 0.5 * ( cam->aabb.first[k] + cam->aabb.second[k] );
+    double3 eye = modelView.transform_point( center );
+    double pixels = mesh_lod_t::projected_size( cam->aabb, scene.local( camModelNodes[i] ).scale, -eye[2], fovy, height );
+    return camLod->select( pixels * lodReferenceHeight / height );       // the same share of the window picks the same level at any size.
 }
 
 void setCamera() {
     unsigned int i;
     if ( frame == 0 ) {
-        // intialize camera model.
-        cam = new wavefront_obj_t( "camera.obj" );  // Read information of camera from camera.obj.
-        camID = glGenLists( 1 );                    // Create display list of the camera.
-        glNewList( camID, GL_COMPILE );         // Begin compiling the display list using camID.
-        cam->draw();                            // Draw the camera. you can do this job again through camID..
-        glEndList();                            // Terminate compiling the display list.
-
-        // initialize camera frame transforms.
-        for ( i = 0; i < cameras.size(); i++ ) {
-            auto &camera = cameras[i];                                          // 'c' points the coordinate of i-th camera.
-            wld2cam.push_back( FrameXform() );                              // Insert {0} matrix to wld2cam vector.
-            glPushMatrix();                                                 // Push the current matrix of GL into stack.
-            glLoadIdentity();                                               // Set the GL matrix Identity matrix.
-            gluLookAt( camera[0], camera[1], camera[2], camera[3], camera[4], camera[5], camera[6], camera[7], camera[8] );     // Setting the coordinate of camera.
-            glGetDoublev( GL_MODELVIEW_MATRIX, wld2cam[i].matrix() );       // Read the world-to-camera matrix computed by gluLookAt.
-            glPopMatrix();                                                  // Transfer the matrix that was pushed the stack to GL.
-            cam2wld.push_back( wld2cam[i].inverse() );                      // Get the camera-to-world matrix.
-        }
-        cameraIndex = 0;
+        loadCameras();
+        for ( i = 0; i < camBuffers.size(); i++ )
+            camMeshes.push_back( new gl_mesh_t( *camBuffers[i] ) );     // Upload every level once. Each draw is then one indexed call.
+        camInstances.resize( camMeshes.size() );
     }
 
     // set viewing transformation.
-    glLoadMatrixd( wld2cam[cameraIndex].matrix() );
-
-    // draw other cameras.
-    for ( i = 0; i < ( int )wld2cam.size(); i++ ) {
-        if ( i != cameraIndex ) {
-            glPushMatrix();                                             // Push the current matrix on GL to stack. The matrix is wld2cam[cameraIndex].matrix().
-            glMultMatrixd( cam2wld[i].matrix() );                           // Multiply the matrix to draw i-th camera.
-            if ( selectMode == 0 ) {                                    // selectMode == 1 means backbuffer mode.
-                drawFrame( 5 );                                         // Draw x, y, and z axis.
-                float frontColor[] = {0.2f, 0.2f, 0.2f, 1.0f};
-                glEnable( GL_LIGHTING );
-                glMaterialfv( GL_FRONT, GL_AMBIENT, frontColor );           // Set ambient property frontColor.
-                glMaterialfv( GL_FRONT, GL_DIFFUSE, frontColor );           // Set diffuse property frontColor.
-            } else {
-                double3 color;
-                glDisable( GL_LIGHTING );                                   // Disable lighting in backbuffer mode.
-                color = munge( i + 1 );                                     // Match the corresponding (i+1)th color to r, g, b. You can change the color of camera on backbuffer.
-                glColor3dv( color.data() );                                     // Set r, g, b the color of camera.
+    FrameXform wld2cam = FrameXform( scene.world( viewNode() ) ).inverse();
+    glLoadMatrixd( wld2cam.matrix() );
+
+    // The frustum of the projection set in reshape(), in world space.
+    pick_view_t view{ scene.world( viewNode() ), width, height, fovy, zNear, zFar };
+    viewPlanes = region_planes( view, screen_point_t{ -0.5, -0.5 }, screen_point_t{ width - 0.5, height - 0.5 } );
+    culledCount = 0;
+
+    // draw other cameras. Each visible camera becomes an instance of its level of detail,
+    // and every level is then drawn with its buffers bound once.
+    for ( auto &instances : camInstances )
+        instances.clear();
+    for ( i = 0; i < ( int )camNodes.size(); i++ ) {
+        if ( !hiddenCamera( i ) ) {
+            if ( !frameInView( scene.world( camNodes[i] ), 5 )
+                 && !box_in_planes( viewPlanes, scene.world( camModelNodes[i] ), cam->aabb.first, cam->aabb.second ) ) {
+                culledCount++;                                          // Neither its axes nor its model can be seen.
+                continue;
             }
-            glScaled( 0.5, 0.5, 0.5 );                                      // Reduce camera size by 1/2.
-            glTranslated( 1.1, 1.1, 0.0 );                                  // Translate it (1.1, 1.1, 0.0).
-            glCallList( camID );                                            // Re-draw using display list from camID.
-            glPopMatrix();                                              // Call the matrix on stack. wld2cam[cameraIndex].matrix() in here.
+            glPushMatrix();                                             // Push the current matrix on GL to stack. The matrix is wld2cam.
+            glMultMatrixd( scene.world( camNodes[i] ).m );              // Multiply the matrix to draw i-th camera's frame.
+            drawFrame( 5 );                                             // Draw x, y, and z axis.
+            glPopMatrix();                                              // Call the matrix on stack. wld2cam in here.
+            gl_mesh_t::instance_t instance;
+            instance.color = { 0.2f, 0.2f, 0.2f, 1.0f };                // Ambient and diffuse property of the camera.
+            instance.model_view = wld2cam * scene.world( camModelNodes[i] );   // The camera model's frame.
+            camInstances[camLevel( i, instance.model_view )].push_back( instance );
         }
     }
+    glEnable( GL_LIGHTING );
+    for ( std::size_t level = 0; level < camMeshes.size(); level++ )
+        camMeshes[level]->draw_instances( camInstances[level] );
 }
 
 
@@ -141,50 +312,214 @@ void drawFrame( float len ) {
     glEnd();                        // End drawing lines.
 }
 
+/*********************************************************************************
+* Whether the axes drawn by drawFrame( len ) in frame may be in view.
+**********************************************************************************/
+bool frameInView( const mat4_t &frame, float len ) {
+    return box_in_planes( viewPlanes, frame, double3{ 0, 0, 0 }, double3{ len, len, len } );
+}
+
+/*********************************************************************************
+* Load the cow and place it. Like loadCameras(), this does not call GL.
+**********************************************************************************/
+void loadCow() {
+    // Read the cow's mesh, or wait for main() to finish reading it.
+    const scene_file_t::instance_t &instance = sceneFile->instances[cowInstance];
+    cow = loadSceneMesh( instance.mesh );
+    cow->print_load_stats( std::cout, sceneFile->meshes[instance.mesh].path.c_str() );
+    cowBvh = new mesh_bvh_t( *cow );
+    cowBuffer = new mesh_buffer_t( *cow );
+    setCowPose( instance.transform.resolve( cow->aabb ) );             // Set the location of cow, and its direction.
+}
+
+/*********************************************************************************
+* Load the scenery and place it. Like loadCow(), this does not call GL.
+**********************************************************************************/
+void loadScenery() {
+    auto start = std::chrono::steady_clock::now();
+    sceneryMeshes.resize( sceneFile->meshes.size() );
+    sceneryBuffers.resize( sceneFile->meshes.size() );
+    for ( int i = 0; i < ( int )sceneFile->instances.size(); i++ ) {
+        if ( i == cowInstance )
+            continue;
+        const scene_file_t::instance_t &instance = sceneFile->instances[i];
+        if ( !sceneryMeshes[instance.mesh] )
+            sceneryMeshes[instance.mesh] = loadSceneMesh( instance.mesh );
+        sceneryInstances.push_back( i );
+        sceneryNodes.push_back( scene.add_node( scene_graph_t::none, instance.transform.resolve( sceneryMeshes[instance.mesh]->aabb ), instance.name ) );
+    }
+
+    // Weld every mesh on its own thread.
+    parallel_for( 0, sceneryMeshes.size(), [&]( std::size_t m ) {
+        if ( sceneryMeshes[m] )
+            sceneryBuffers[m] = new mesh_buffer_t( *sceneryMeshes[m] );
+    }, 1 );
+    if ( !sceneryInstances.empty() )
+        printf( "scenery: %d instances of %d meshes in %.1f ms\n", ( int )sceneryInstances.size(),
+                ( int )std::count_if( sceneryMeshes.begin(), sceneryMeshes.end(), []( const asset_cache_t<wavefront_obj_t>::handle_t &mesh ) { return bool( mesh ); } ),
+                std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count() );
+}
+
+/*********************************************************************************
+* Draw the scenery, every mesh's visible instances together.
+**********************************************************************************/
+void drawScenery() {
+    if ( frame == 0 ) {
+        loadScenery();
+        sceneryGlMeshes.resize( sceneryBuffers.size() );
+        sceneryDraws.resize( sceneryBuffers.size() );
+        for ( std::size_t m = 0; m < sceneryBuffers.size(); m++ ) {
+            if ( sceneryBuffers[m] )
+                sceneryGlMeshes[m] = new gl_mesh_t( *sceneryBuffers[m] );
+        }
+    }
+
+    FrameXform wld2cam = FrameXform( scene.world( viewNode() ) ).inverse();
+    for ( auto &draws : sceneryDraws )
+        draws.clear();
+    for ( std::size_t i = 0; i < sceneryNodes.size(); i++ ) {
+        const scene_file_t::instance_t &instance = sceneFile->instances[sceneryInstances[i]];
+        const wavefront_obj_t &mesh = *sceneryMeshes[instance.mesh];
+        if ( !box_in_planes( viewPlanes, scene.world( sceneryNodes[i] ), mesh.aabb.first, mesh.aabb.second ) ) {
+            culledCount++;
+            continue;
+        }
+        gl_mesh_t::instance_t draw;
+        draw.model_view = wld2cam * scene.world( sceneryNodes[i] );
+        draw.color = instance.color;
+        draw.materials = !instance.color_set && !sceneryBuffers[instance.mesh]->materials.empty();
+        sceneryDraws[instance.mesh].push_back( draw );
+    }
+    glEnable( GL_LIGHTING );
+    for ( std::size_t m = 0; m < sceneryGlMeshes.size(); m++ ) {
+        if ( !sceneryDraws[m].empty() )
+            sceneryGlMeshes[m]->draw_instances( sceneryDraws[m] );
+    }
+}
+
 /*********************************************************************************
 * Draw 'cow' object.
 **********************************************************************************/
 void drawCow() {
     if ( frame == 0 ) {
         // Initialization part.
+        loadCow();
+
+        // Upload the welded, triangulated cow. After this, you can draw cow using 'cowMesh'.
+        cowMesh = new gl_mesh_t( *cowBuffer );
+
+        // Partition the cow into clusters that can be culled separately, and compile each into a display list.
+        cowClusters = new mesh_cluster_t( *cow );
+        for ( auto &cluster : cowClusters->clusters ) {
+            cowClusterIDs.push_back( glGenLists( 1 ) );
+            glNewList( cowClusterIDs.back(), GL_COMPILE );
+            cowClusters->draw( cluster );
+            glEndList();
+        }
+    }
 
-        // Read information from cow.obj.
-        cow = new wavefront_obj_t( "cow.obj" );
-
-        // Make display list. After this, you can draw cow using 'cowID'.
-        cowID = glGenLists( 1 );                // Create display lists
-        glNewList( cowID, GL_COMPILE );     // Begin compiling the display list using cowID
-        cow->draw();                        // Draw the cow on display list.
-        glEndList();                        // Terminate compiling the display list. Now, you can draw cow using 'cowID'.
-        glPushMatrix();                     // Push the current matrix of GL into stack.
-        glLoadIdentity();                   // Set the GL matrix Identity matrix.
-        glTranslated( 0, -cow->aabb.first[1], -8 ); // Set the location of cow.
-        glRotated( -90, 0, 1, 0 );          // Set the direction of cow. These information are stored in the matrix of GL.
-        glGetDoublev( GL_MODELVIEW_MATRIX, cow2wld.matrix() );  // Read the modelview matrix about location and direction set above, and store it in cow2wld matrix.
-        glPopMatrix();                      // Pop the matrix on stack to GL.
+    if ( !frameInView( scene.world( cowNode ), 5 )
+         && !box_in_planes( viewPlanes, scene.world( cowNode ), cow->aabb.first, cow->aabb.second ) ) {
+        culledCount++;  // Out of view, so nothing to draw.
+        return;
     }
 
     glPushMatrix();     // Push the current matrix of GL into stack. This is because the matrix of GL will be change while drawing cow.
 
-    // The information about location of cow to be drawn is stored in cow2wld matrix.
-    // (Project2 hint) If you change the value of the cow2wld matrix or the current matrix, cow would rotate or move.
+    // The information about location of cow to be drawn is stored in the cow's scene node.
+    // (Project2 hint) If you change the cow's pose or the current matrix, cow would rotate or move.
+    FrameXform cow2wld = scene.world( cowNode );
     glMultMatrixd( cow2wld.matrix() );
 
-    if ( selectMode == 0 ) {                                // selectMode == 1 means backbuffer mode.
-        drawFrame( 5 );                                     // Draw x, y, and z axis.
-        float frontColor[] = {0.8f, 0.2f, 0.9f, 1.0f};
-        glEnable( GL_LIGHTING );
-        glMaterialfv( GL_FRONT, GL_AMBIENT, frontColor );       // Set ambient property frontColor.
-        glMaterialfv( GL_FRONT, GL_DIFFUSE, frontColor );       // Set diffuse property frontColor.
-    } else {
-        glDisable( GL_LIGHTING );                               // Disable lighting in backbuffer mode.
-        double3 color = munge( 32 );                                    // Match the corresponding constant color to r, g, b. You can change the color of camera on backbuffer
-        glColor3dv( color.data() );
-    }
-    glCallList( cowID );        // Draw cow.
+    drawFrame( 5 );                                         // Draw x, y, and z axis.
+    const float *frontColor = sceneFile->instances[cowInstance].color.data();
+    glEnable( GL_LIGHTING );
+    glMaterialfv( GL_FRONT, GL_AMBIENT, frontColor );       // Set ambient property frontColor.
+    glMaterialfv( GL_FRONT, GL_DIFFUSE, frontColor );       // Set diffuse property frontColor.
+    if ( drawClusters ) {
+        // Find the viewer and the view frustum in cow space, and draw only the clusters which may face it and be in view.
+        const mat4_t &c2w = scene.world( viewNode() );
+        double3 eye = cow2wld.inverse().transform_point( double3{ c2w.m[12], c2w.m[13], c2w.m[14] } );
+        std::vector<mesh_cluster_t::plane_t> planes;
+        for ( auto &p : viewPlanes ) {
+            mesh_cluster_t::plane_t q;                              // p * cow2wld, so q( x ) = p( cow2wld * x ).
+            for ( int j = 0; j < 4; j++ )
+                q[j] = p[0] * cow2wld( 0, j ) + p[1] * cow2wld( 1, j ) + p[2] * cow2wld( 2, j ) + p[3] * cow2wld( 3, j );
+            planes.push_back( q );
+        }
+        for ( std::size_t c = 0; c < cowClusters->clusters.size(); c++ ) {
+            const mesh_cluster_t::cluster_t &cluster = cowClusters->clusters[c];
+            if ( !cowClusters->is_backfacing( cluster, eye ) && !cowClusters->is_outside( cluster, planes ) )
+                glCallList( cowClusterIDs[c] );
+        }
+    } else
+        cowMesh->draw();        // Draw cow.
     glPopMatrix();          // Pop the matrix in stack to GL. Change it the matrix before drawing cow.
 }
 
+/*********************************************************************************
+* Texels of the size x size floor texture: a checker pattern of 8 x 8 squares.
+**********************************************************************************/
+texel_fn_t floorTexels( int size ) {
+    return [size]( int x, int y, std::uint8_t *rgb ) {
+        // Insert color according to checker pattern.
+        if ( ( ( x * 8 / size ) ^ ( y * 8 / size ) ) & 1 ) {
+            rgb[0] = 200;
+            rgb[1] = 32;
+            rgb[2] = 32;
+        } else {
+            rgb[0] = 200;
+            rgb[1] = 200;
+            rgb[2] = 32;
+        }
+    };
+}
+
+/*********************************************************************************
+* Swap in the full-size floor texture once its worker thread has made it.
+* Until then the floor keeps the 8 x 8 texture made at start-up.
+**********************************************************************************/
+void uploadFloorTexture() {
+    if ( !floorTextureJob.valid() || floorTextureJob.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready )
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    mip_texture_t texture = floorTextureJob.get();
+    glBindTexture( GL_TEXTURE_2D, floorTexID );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );                        // Rows are tightly packed, whatever their width.
+    for ( std::size_t level = 0; level < texture.levels.size(); level++ ) {
+        const mip_texture_t::level_t &mip = texture.levels[level];
+        glTexImage2D( GL_TEXTURE_2D, GLint( level ), GL_RGB8, mip.width, mip.height, 0, GL_RGB, GL_UNSIGNED_BYTE, mip.rgb.data() );
+    }
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+    glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );   // Far away, the squares blend instead of shimmering.
+    if ( verbose )
+        printf( "floor texture %dx%d, %d levels, %.1f MB uploaded in %.2f ms\n", texture.levels[0].width, texture.levels[0].height,
+                ( int )texture.levels.size(), texture.memory_size() / 1048576.0,
+                std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count() );
+}
+
+// Poll the floor texture job without drawing, so the new texture shows even when no input arrives.
+void onFloorTextureTimer( int ) {
+    if ( floorTextureJob.valid() && floorTextureJob.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready )
+        glutTimerFunc( 50, onFloorTextureTimer, 0 );
+    else
+        glutPostRedisplay();
+}
+
+/*********************************************************************************
+* Choose the ground tiles around the current camera that are in view.
+**********************************************************************************/
+void selectGround() {
+    const mat4_t &cam2wld = scene.world( viewNode() );
+    int culled = ground.select( double3{ cam2wld.m[12], cam2wld.m[13], cam2wld.m[14] }, viewPlanes, groundTiles );
+    if ( verbose && ( int )groundTiles.size() != lastGroundTiles ) {
+        printf( "ground: %d tiles of %d triangles, %d culled\n", ( int )groundTiles.size(), ( int )ground.grid().triangle_count(), culled );
+        lastGroundTiles = ( int )groundTiles.size();
+    }
+}
+
 /*********************************************************************************
 * Draw floor on 3D plane.
 **********************************************************************************/
@@ -193,20 +528,8 @@ void drawFloor() {
         // Initialization part.
         // After making checker-patterned texture, use this repetitively.
 
-        // Insert color into checker[] according to checker pattern.
         const int size = 8;
-        unsigned char checker[size * size * 3];
-        for( int i = 0; i < size * size; i++ ) {
-            if ( ( ( i / size ) ^ i ) & 1 ) {
-                checker[3 * i + 0] = 200;
-                checker[3 * i + 1] = 32;
-                checker[3 * i + 2] = 32;
-            } else {
-                checker[3 * i + 0] = 200;
-                checker[3 * i + 1] = 200;
-                checker[3 * i + 2] = 32;
-            }
-        }
+        std::vector<std::uint8_t> checker = generate_texture( size, size, floorTexels( size ), false ).levels[0].rgb;
 
         // Make texture which is accessible through floorTexID.
         glGenTextures( 1, &floorTexID );
@@ -216,40 +539,45 @@ void drawFloor() {
         glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
         glTexParameterf( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
         glTexEnvf( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE );
-        glTexImage2D( GL_TEXTURE_2D, 0, 3, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, checker );
+        glTexImage2D( GL_TEXTURE_2D, 0, 3, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, checker.data() );
+
+        // Generate the full-size texture with its mipmaps off the render thread.
+        GLint maxSize;
+        glGetIntegerv( GL_MAX_TEXTURE_SIZE, &maxSize );
+        int fullSize = std::min( floorTextureSize, int( maxSize ) );
+        floorTextureJob = generate_texture_async( fullSize, fullSize, floorTexels( fullSize ) );
+        glutTimerFunc( 50, onFloorTextureTimer, 0 );
+
+        groundMesh = new gl_mesh_t( ground.grid() );
     }
+    uploadFloorTexture();
 
     glDisable( GL_LIGHTING );
 
     // Set background color.
-    if ( selectMode == 0 )
-        glColor3d( 0.35, .2, 0.1 );
-    else {
-        // In backbuffer mode.
-        double3 color = munge(34);
-        glColor3dv(color.data());
+    gl_mesh_t::instance_t tile;
+    tile.color = { 0.35f, 0.2f, 0.1f, 1.0f };
+
+    // Draw the ground in view as tiles, finer near the camera.
+    selectGround();
+    FrameXform wld2cam = FrameXform( scene.world( viewNode() ) ).inverse();
+    std::vector<gl_mesh_t::instance_t> tiles;
+    for ( auto &t : groundTiles ) {
+        tile.model_view = wld2cam * ground.tile_matrix( t );
+        tiles.push_back( tile );
     }
+    groundMesh->draw_instances( tiles );
 
-    // Draw background rectangle.
-    glBegin( GL_POLYGON );
-    glVertex3f( 2000, -0.2, 2000 );
-    glVertex3f( 2000, -0.2, -2000 );
-    glVertex3f( -2000, -0.2, -2000 );
-    glVertex3f( -2000, -0.2, 2000 );
-    glEnd();
-
-
-    // Set color of the floor.
-    if ( selectMode == 0 ) {
-        // Assign checker-patterned texture.
-        glEnable( GL_TEXTURE_2D );
-        glBindTexture( GL_TEXTURE_2D, floorTexID );
-    } else {
-        // Assign color on backbuffer mode.
-        double3 color = munge(35);
-        glColor3dv(color.data());
+    // The ground stays, but the floor and its axes are skipped when out of view.
+    if ( !frameInView( mat4_t(), 5 ) && !box_in_planes( viewPlanes, mat4_t(), double3{ -12, -0.1, -12 }, double3{ 12, -0.1, 12 } ) ) {
+        culledCount++;
+        return;
     }
 
+    // Assign checker-patterned texture.
+    glEnable( GL_TEXTURE_2D );
+    glBindTexture( GL_TEXTURE_2D, floorTexID );
+
     // Draw the floor. Match the texture's coordinates and the floor's coordinates resp.
     glBegin( GL_POLYGON );
     glTexCoord2d( 0, 0 );
@@ -262,13 +590,46 @@ void drawFloor() {
     glVertex3d( -12, -0.1, 12 );        // Texture's (0,1) is bound to (-12,-0.1,12).
     glEnd();
 
-    if ( selectMode == 0 ) {
-        glDisable( GL_TEXTURE_2D );
-        drawFrame( 5 );             // Draw x, y, and z axis.
-    }
+    glDisable( GL_TEXTURE_2D );
+    drawFrame( 5 );             // Draw x, y, and z axis.
 }
 
 
+/*********************************************************************************
+* Draw the outline of the right-button selection over the scene, in pixels.
+**********************************************************************************/
+void drawSelectOutline() {
+    if ( selectOutline.size() < 2 )
+        return;
+    glMatrixMode( GL_PROJECTION );
+    glPushMatrix();
+    glLoadIdentity();
+    gluOrtho2D( -0.5, width - 0.5, -0.5, height - 0.5 );           // One unit per pixel, pixel centers on integers.
+    glMatrixMode( GL_MODELVIEW );
+    glPushMatrix();
+    glLoadIdentity();
+    glDisable( GL_LIGHTING );
+    glDisable( GL_DEPTH_TEST );
+    glColor3d( 1, 1, 1 );
+    glBegin( GL_LINE_LOOP );
+    if ( lassoSelect ) {
+        for ( auto &p : selectOutline )
+            glVertex2d( p[0], p[1] );
+    } else {
+        const screen_point_t &a = selectOutline.front(), &b = selectOutline.back();
+        glVertex2d( a[0], a[1] );
+        glVertex2d( b[0], a[1] );
+        glVertex2d( b[0], b[1] );
+        glVertex2d( a[0], b[1] );
+    }
+    glEnd();
+    glEnable( GL_DEPTH_TEST );
+    glPopMatrix();
+    glMatrixMode( GL_PROJECTION );
+    glPopMatrix();
+    glMatrixMode( GL_MODELVIEW );
+}
+
 /*********************************************************************************
 * Call this part whenever display events are needed.
 * Display events are called in case of re-rendering by OS. ex) screen movement, screen maximization, etc.
@@ -276,24 +637,38 @@ void drawFloor() {
 * this part is called in main() function by registering on glutDisplayFunc(display).
 **********************************************************************************/
 void display() {
-    // selectMode == 1 means backbuffer mode.
-    if ( selectMode == 0 )
-        glClearColor( 0, 0.6, 0.8, 1 );                             // Clear color setting
-    else
-        glClearColor( 0, 0, 0, 1 );                                 // When the backbuffer mode, clear color is set to black
+    glClearColor( 0, 0.6, 0.8, 1 );                                 // Clear color setting
     glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );               // Clear the screen
+    applyDrag();                                                    // Move the cow for all mouse motion since the last frame.
     setCamera();                                                    // Locate the camera's position, and draw all of them.
 
     drawFloor();                                                    // Draw floor.
     drawCow();                                                      // Draw cow.
+    drawScenery();                                                  // Draw everything else the scene file places.
+    drawSelectOutline();                                            // Draw the selection box or lasso being dragged.
+
+    if ( verbose && culledCount != lastCulledCount ) {
+        printf( "culled %d of %d objects\n", culledCount, ( int )( camNodes.size() + sceneryNodes.size() ) + ( flying ? 2 : 1 ) );  // the other cameras, the cow, the floor and the scenery.
+        lastCulledCount = culledCount;
+    }
 
 
     glFlush();
 
-    // If it is not backbuffer mode, swap the screen. In backbuffer mode, this is not necessary because it is not presented on screen.
-    if ( selectMode == 0 )
-        glutSwapBuffers();
+    glutSwapBuffers();                                              // Show the frame.
     frame += 1;
+
+    // Replaying: the frame counts as presented once GL has finished it.
+    if ( !replayLog.events.empty() ) {
+        glFinish();
+        replayLatency.presented();
+        if ( replayNext == replayLog.events.size() ) {
+            printf( "replayed %d events in %.2f s\n", ( int )replayLog.events.size(),
+                    std::chrono::duration<double>( std::chrono::steady_clock::now() - replayStart ).count() );
+            replayLatency.print( std::cout );
+            exit( 0 );
+        }
+    }
 }
 
 
@@ -302,6 +677,8 @@ void display() {
 * This part is called in main() function by registering on glutReshapeFunc(reshape).
 **********************************************************************************/
 void reshape( int w, int h ) {
+    if ( inputRecorder )
+        inputRecorder->record( input_event_t::reshape, 0, 0, w, h, 0 );
     width = w;
     height = h;
     glViewport( 0, 0, width, height );
@@ -309,11 +686,20 @@ void reshape( int w, int h ) {
     glLoadIdentity();                       // Reset The Projection Matrix
     // Define perspective projection frustum
     double aspect = width / double( height );
-    gluPerspective( 45, aspect, 1, 1024 );
+    gluPerspective( fovy, aspect, zNear, zFar );
     glMatrixMode( GL_MODELVIEW );           // Select The Modelview Matrix
     glLoadIdentity();                       // Reset The Projection Matrix
 }
 
+/*********************************************************************************
+* The lights of the scene file. A scene without any gets one default light.
+**********************************************************************************/
+std::vector<scene_file_t::light_t> sceneLights() {
+    if ( sceneFile->lights.empty() )
+        return std::vector<scene_file_t::light_t>( 1 );
+    return sceneFile->lights;
+}
+
 void initialize() {
     // Set up OpenGL state
     glShadeModel( GL_SMOOTH );       // Set Smooth Shading
@@ -324,13 +710,76 @@ void initialize() {
     // Initialize the matrix stacks
     reshape( width, height );
     // Define lighting for the scene
-    float lightDirection[]   = {1.0, 1.0, 1.0, 0};
-    float ambientIntensity[] = {0.1, 0.1, 0.1, 1.0};
-    float lightIntensity[]   = {0.9, 0.9, 0.9, 1.0};
-    glLightfv( GL_LIGHT0, GL_AMBIENT, ambientIntensity );
-    glLightfv( GL_LIGHT0, GL_DIFFUSE, lightIntensity );
-    glLightfv( GL_LIGHT0, GL_POSITION, lightDirection );
-    glEnable( GL_LIGHT0 );
+    std::vector<scene_file_t::light_t> lights = sceneLights();
+    for ( std::size_t i = 0; i < lights.size(); i++ ) {
+        const scene_file_t::light_t &light = lights[i];
+        float lightDirection[]   = {float( light.direction[0] ), float( light.direction[1] ), float( light.direction[2] ), 0};
+        float ambientIntensity[] = {light.ambient, light.ambient, light.ambient, 1.0};
+        float lightIntensity[]   = {light.diffuse, light.diffuse, light.diffuse, 1.0};
+        glLightfv( GL_LIGHT0 + i, GL_AMBIENT, ambientIntensity );
+        glLightfv( GL_LIGHT0 + i, GL_DIFFUSE, lightIntensity );
+        glLightfv( GL_LIGHT0 + i, GL_POSITION, lightDirection );
+        glEnable( GL_LIGHT0 + i );
+    }
+}
+
+/*********************************************************************************
+* Find the nearest object under pixel (x, y), y counted from the bottom.
+* Object ids are i + 1 for camera i, 32 for the cow and 35 for the floor. The
+* floor reports face -1.
+**********************************************************************************/
+std::vector<pick_target_t> pickTargets() {
+    std::vector<pick_target_t> targets;
+    for ( int i = 0; i < ( int )camNodes.size(); i++ ) {
+        if ( !hiddenCamera( i ) )
+            targets.push_back( pick_target_t{ i + 1, camBvh, scene.world( camModelNodes[i] ) } );
+    }
+    targets.push_back( pick_target_t{ 32, cowBvh, scene.world( cowNode ) } );
+    return targets;
+}
+
+bool pickScene( int x, int y, pick_hit_t &hit ) {
+    if ( camNodes.empty() || !camBvh || !cowBvh )
+        return false;                                               // Nothing is loaded before the first frame.
+
+    std::vector<pick_target_t> targets = pickTargets();
+    double3 origin, dir;
+    pixel_ray( scene.world( viewNode() ), x, y, width, height, fovy, origin, dir );
+    bool found = pick( targets, origin, dir, hit );
+
+    // The floor is the square |x|, |z| <= 12 at y = -0.1.
+    if ( dir[1] != 0 ) {
+        double t = ( -0.1 - origin[1] ) / dir[1];
+        double3 p = { origin[0] + t * dir[0], -0.1, origin[2] + t * dir[2] };
+        if ( t >= 0 && ( !found || t < hit.t ) && std::fabs( p[0] ) <= 12 && std::fabs( p[2] ) <= 12 ) {
+            hit = pick_hit_t{ 35, -1, t, p };
+            found = true;
+        }
+    }
+    return found;
+}
+
+/*********************************************************************************
+* Select every camera model and the cow inside selectOutline, and print them
+* with the number of their faces inside. The floor is not selectable this way.
+**********************************************************************************/
+void selectScene() {
+    if ( camNodes.empty() || !camBvh || !cowBvh || selectOutline.empty() )
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+    pick_view_t view{ scene.world( viewNode() ), width, height, fovy, zNear, zFar };
+    selection_t selection;
+    if ( lassoSelect )
+        select_lasso( pickTargets(), view, selectOutline, true, selection );
+    else
+        select_box( pickTargets(), view, selectOutline.front(), selectOutline.back(), true, selection );
+    double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+    printf( "%s selected %d objects in %.2f ms:", lassoSelect ? "lasso" : "box", ( int )selection.objects.size(), ms );
+    for ( std::size_t k = 0; k < selection.objects.size(); k++ )
+        printf( " %d (%d faces)", selection.objects[k], ( int )selection.faces[k].size() );
+    printf( "\n" );
 }
 
 /*********************************************************************************
@@ -338,20 +787,21 @@ void initialize() {
 * This part is called in main() function by registering on glutMouseFunc(onMouseButton).
 **********************************************************************************/
 void onMouseButton( int button, int state, int x, int y ) {
+    if ( inputRecorder )
+        inputRecorder->record( input_event_t::button, button, state, x, y, glutGetModifiers() );
     y = height - y - 1;
+    dragButton = state == GLUT_DOWN ? button : -1;
     if ( button == GLUT_LEFT_BUTTON ) {
         if ( state == GLUT_DOWN ) {
             printf( "Left mouse click at (%d, %d)\n", x, y );
+            applyDrag();                                                // Finish the previous drag from its own starting point.
 
-            // Change the value of selectMode to 1, then draw the object on backbuffer when display() function is called.
-            selectMode = 1;
-            display();
-            glReadBuffer( GL_BACK );
-            unsigned char pixel[3];
-            glReadPixels( x, y, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, pixel );
-            double3 pixel_d3 = { double(pixel[0]), double(pixel[1]), double(pixel[2]) };
-            printf("pixel = %d\n", unmunge(pixel_d3));
-            selectMode = 0;
+            // Cast a ray through the clicked pixel, instead of drawing the scene on backbuffer and reading the pixel back.
+            pick_hit_t hit;
+            if ( pickScene( x, y, hit ) )
+                printf( "picked object %d, face %d at (%f, %f, %f)\n", hit.object, hit.face, hit.point[0], hit.point[1], hit.point[2] );
+            else
+                printf( "picked nothing\n" );
 
             // Save current clicked location of mouse here, and then use this on onMouseDrag function.
             oldX = x;
@@ -361,9 +811,17 @@ void onMouseButton( int button, int state, int x, int y ) {
             trans_oldY = y;
         }
     } else if ( button == GLUT_RIGHT_BUTTON ) {
-        printf( "Right mouse click at (%d, %d)\n", x, y );
+        // Dragging with the right button selects everything in a box, or in a lasso when shift is held.
+        if ( state == GLUT_DOWN ) {
+            printf( "Right mouse click at (%d, %d)\n", x, y );
+            lassoSelect = ( eventModifiers() & GLUT_ACTIVE_SHIFT ) != 0;
+            selectOutline.assign( 1, screen_point_t{ double( x ), double( y ) } );
+        } else {
+            selectScene();
+            selectOutline.clear();
+        }
     }
-    glutPostRedisplay();
+    postRedisplay();
 }
 
 
@@ -371,50 +829,75 @@ void onMouseButton( int button, int state, int x, int y ) {
 /*********************************************************************************
 * Call this part whenever user drags mouse.
 * Input parameters x, y are coordinate of mouse on dragging.
-* Value of global variables oldX, oldY is stored on onMouseButton,
-* Then, those are used to verify value of x - oldX,  y - oldY to know its movement.
+* Motion events only record the cursor; however many arrive between two frames,
+* display() moves the cow once for all of them through applyDrag().
 **********************************************************************************/
 void onMouseDrag( int x, int y ) {
+    if ( inputRecorder )
+        inputRecorder->record( input_event_t::motion, 0, 0, x, y, 0 );
     y = height - y - 1;
-    printf( "in drag (%d, %d)\n", x - oldX,  y - oldY );
+    if ( dragButton == GLUT_RIGHT_BUTTON ) {
+        // Grow the selection outline; the cow is only moved by the left button.
+        screen_point_t p{ double( x ), double( y ) };
+        if ( lassoSelect )
+            selectOutline.push_back( p );
+        else {
+            selectOutline.resize( 1 );                                  // Keep the corner where the drag started.
+            selectOutline.push_back( p );
+        }
+        postRedisplay();
+        return;
+    }
+
+    dragX = x;
+    dragY = y;
+    dragEvents++;
+    if ( !dragPending ) {
+        dragPending = true;
+        postRedisplay();
+    }
+}
+
+/*********************************************************************************
+* Move the cow for the drag up to the latest cursor position (dragX, dragY).
+* Value of global variables oldX, oldY is stored on onMouseButton,
+* Then, those are used to verify value of x - oldX,  y - oldY to know its movement.
+* Each step below only adds the motion since the previous one, so one call for
+* the latest position moves the cow as far as one call per motion event would.
+**********************************************************************************/
+void applyDrag() {
+    if ( !dragPending || camNodes.empty() )
+        return;
+    dragPending = false;
+    int x = dragX, y = dragY;
+    if ( verbose )
+        printf( "in drag (%d, %d), %d motion events\n", x - oldX,  y - oldY, dragEvents );
+    dragEvents = 0;
 
     // (Project 2, 3) TODO : Implement here to perform properly when drag the mouse on each case, respectively.
     /*********************************************************************************/
 	if (transMode == 'm') {
-		glPushMatrix();
-		glLoadIdentity();
-		glMultMatrixd(cow2wld.matrix());
 		if (oldX != amount[togDirection]) {
 			dist[togDirection] = 0;
 		}
-		float trans[3] = { 0, 0, 0 };
+		double trans[3] = { 0, 0, 0 };
 		trans[togDirection] = (x - oldX - dist[togDirection]) / 12;
-		glTranslatef(trans[0], trans[1], trans[2]);
-		glGetDoublev(GL_MODELVIEW_MATRIX, cow2wld.matrix());
+		setCowPose(cowPose() * rigid_xform_t::translate(trans[0], trans[1], trans[2]));
 		dist[togDirection] = double(x - oldX);
 		amount[togDirection] = double(oldX);
-		glPopMatrix();
 	}
 	if (transMode == 'w') {		//added functionality to differentiate the effect: if c is multiplied first, change according to the world
-		glPushMatrix();
-		glLoadIdentity();
 		if (oldX != amount[togDirection]) {
 			dist[togDirection] = 0;
 		}
-		float trans[3] = { 0, 0, 0 };
+		double trans[3] = { 0, 0, 0 };
 		trans[togDirection] = (x - oldX - dist[togDirection]) / 12;
-		glTranslatef(trans[0], trans[1], trans[2]);
-		glMultMatrixd(cow2wld.matrix());
-		glGetDoublev(GL_MODELVIEW_MATRIX, cow2wld.matrix());
+		setCowPose(rigid_xform_t::translate(trans[0], trans[1], trans[2]) * cowPose());
 		dist[togDirection] = double(x - oldX);
 		amount[togDirection] = double(oldX);
-		glPopMatrix();
 	}
 	if (transMode == 'v') {
-		glPushMatrix();
-		glLoadIdentity();
-		glMultMatrixd(cam2wld[cameraIndex].matrix());
-		float trans[3] = { 0, 0, 0 };
+		double trans[3] = { 0, 0, 0 };
 		if (togDirection < 2) {
 			if (trans_oldX != amount[0]) {
 				dist[0] = 0;
@@ -424,7 +907,6 @@ void onMouseDrag( int x, int y ) {
 			}
 			trans[0] = (x - trans_oldX - dist[0]) / 12;
 			trans[1] = (y - trans_oldY - dist[1]) / 12;
-			glTranslatef(trans[0], trans[1], trans[2]);
 			dist[0] = double(x - trans_oldX);
 			dist[1] = double(y - trans_oldY);
 			amount[0] = double(trans_oldX);
@@ -435,22 +917,18 @@ void onMouseDrag( int x, int y ) {
 				dist[togDirection] = 0;
 			}
 			trans[togDirection] = (x - trans_oldX - dist[togDirection]) / 12;
-			glTranslatef(trans[0], trans[1], trans[2]);
 			dist[togDirection] = double(x - trans_oldX);
 			amount[togDirection] = double(trans_oldX);
 		}
 
-		glMultMatrixd(wld2cam[cameraIndex].matrix());
-		glMultMatrixd(cow2wld.matrix());
-		glGetDoublev(GL_MODELVIEW_MATRIX, cow2wld.matrix());
-		glPopMatrix();
+		// translate in the viewing frame: cam2wld * T * wld2cam * cow2wld
+		const rigid_xform_t &camPose = scene.local(viewNode());     // cameras are roots, so local is cam2wld
+		setCowPose(camPose * rigid_xform_t::translate(trans[0], trans[1], trans[2]) * camPose.inverse() * cowPose());
 	}
 
 
 
     /*********************************************************************************/
-
-    glutPostRedisplay();
 }
 
 /*********************************************************************************
@@ -458,7 +936,9 @@ void onMouseDrag( int x, int y ) {
 * This part is called in main() function by registering on glutKeyboardFunc(onKeyPress).
 **********************************************************************************/
 void onKeyPress( unsigned char key, int x, int y ) {
-    
+	if (inputRecorder)
+		inputRecorder->record(input_event_t::key, key, 0, x, y, glutGetModifiers());
+
 	// If 'c' or space bar are pressed, alter the camera.
 	// If a number is pressed, alter the camera corresponding the number.
 	if ((key == ' ') || (key == 'c')) {
@@ -468,13 +948,14 @@ void onKeyPress( unsigned char key, int x, int y ) {
 	else if ((key >= '0') && (key <= '9'))
 		cameraIndex = key - '0';
 
-	if (cameraIndex >= (int)wld2cam.size())
+	if (cameraIndex >= (int)camNodes.size())
 		cameraIndex = 0;
 
 	// (Project 2, 3) TODO : Implement here to handle keyboard input.
     /*********************************************************************************/
 	if (key == 'x') {
-		printf("%f %f %f\n", cam2wld[cameraIndex].matrix()[4], cam2wld[cameraIndex].matrix()[5], cam2wld[cameraIndex].matrix()[6]);
+		const mat4_t &c2w = scene.world(viewNode());
+		printf("%f %f %f\n", c2w.m[4], c2w.m[5], c2w.m[6]);
 		togDirection = 0;
 	}
 	if (key == 'y') {
@@ -486,26 +967,23 @@ void onKeyPress( unsigned char key, int x, int y ) {
 	if (key == 'r') {
 		if (!rotateOn) {
 			if (rotx == 0 && roty == 0 && rotz == 0) {
-				double rotate[16];
-				glPushMatrix();
-				glLoadIdentity();
-				glMultMatrixd(cow2wld.inverse().matrix());
-				glMultMatrixd(cam2wld[cameraIndex].matrix());
-				glGetDoublev(GL_MODELVIEW_MATRIX, rotate);
-				glPopMatrix();
-				rotx = rotate[0];
-				roty = rotate[1];
-				rotz = rotate[2];
+				// the viewer's x axis in cow space
+				double3 axis = (cowPose().inverse() * scene.local(viewNode())).rotation.rotate(double3{ 1, 0, 0 });
+				rotx = axis[0];
+				roty = axis[1];
+				rotz = axis[2];
 			}
 			if (transMode == 'v') {
 				printf("%f %f %f\n", rotx, roty, rotz);
-				glutIdleFunc(spinCow);
+				spinTask = animator.start(spinCow, animationNow());
+				startAnimationTimer();
 			}
 			rotateOn = true;
 		}
 		else if (rotateOn) {
 			printf("rotate off\n");
-			glutIdleFunc(NULL);
+			animator.stop(spinTask);		// the pending timer finds nothing to animate and lets GLUT sleep
+			spinTask = -1;
 			rotateOn = false;
 		}
 	}
@@ -518,27 +996,466 @@ void onKeyPress( unsigned char key, int x, int y ) {
 	if (key == 'w') {
 		transMode = 'w';
 	}
+	if (key == 'f') {
+		if (!flying) {
+			flyPoses = flythroughPath(int(flySeconds * camNodes.size() / animator.step_seconds()));
+			if (flyPoses.empty())
+				printf("flythrough needs at least two cameras\n");
+			else {
+				flyFrame = 0;
+				scene.set_local(flyNode, flyPoses[0]);
+				flying = true;
+				flyTask = animator.start(flyStep, animationNow());
+				startAnimationTimer();
+				printf("flythrough on, %d poses\n", (int)flyPoses.size());
+			}
+		}
+		else {
+			printf("flythrough off\n");
+			animator.stop(flyTask);
+			flyTask = -1;
+			flying = false;
+		}
+	}
+	if (key == 'k') {
+		drawClusters = !drawClusters;
+		printf("draw cow clusters %s\n", drawClusters ? "on" : "off");
+	}
     /*********************************************************************************/
 
+    postRedisplay();
+}
+
+// One fixed animation step of dt seconds, run by animator.
+void spinCow(double dt) {
+	setCowPose(cowPose() * rigid_xform_t::rotate(spinSpeed * dt, rotx, roty, rotz));    // the pose renormalizes itself, so spinning never skews the cow
+}
+
+/*********************************************************************************
+* A closed flythrough through every camera, starting at the current one, as
+* count poses evenly spaced along the path. Empty if there are fewer than two
+* cameras to fly between, or count is not positive.
+**********************************************************************************/
+std::vector<rigid_xform_t> flythroughPath( int count ) {
+    if ( camNodes.size() < 2 || count <= 0 )
+        return std::vector<rigid_xform_t>();
+    std::vector<rigid_xform_t> keys;
+    for ( std::size_t k = 0; k < camNodes.size(); k++ )
+        keys.push_back( scene.local( camNodes[( cameraIndex + k ) % camNodes.size()] ) );   // cameras are roots, so local is cam2wld
+    return camera_path_t( keys, true ).bake( count );
+}
+
+// One animation step of the flythrough: move the flying camera to its next pose.
+void flyStep( double ) {
+    flyFrame = ( flyFrame + 1 ) % flyPoses.size();
+    scene.set_local( flyNode, flyPoses[flyFrame] );
+}
+
+/*********************************************************************************
+* Animation frames. While anything animates, a GLUT timer fires at the target
+* frame rate, runs the animation steps due since the last frame and requests a
+* redraw. With nothing animating no timer is set, so GLUT sleeps until input.
+**********************************************************************************/
+void onAnimationTimer( int ) {
+    animationTimerSet = false;
+    if ( !animator.animating() )
+        return;
+    animator.advance();
     glutPostRedisplay();
+    startAnimationTimer();
+}
+
+void startAnimationTimer() {
+    if ( headless || animationTimerSet || !animator.animating() )
+        return;                                                     // Headless replay advances the animator itself.
+    glutTimerFunc( animator.frame_delay_ms(), onAnimationTimer, 0 );
+    animationTimerSet = true;
+}
+
+/*********************************************************************************
+* A software render target of the window's size, projected as reshape() sets
+* GL up and lit as initialize() does. It has one light, so the first light of
+* the scene is used, with the others only adding their ambient.
+**********************************************************************************/
+soft_raster_t softRaster() {
+    soft_raster_t raster( width, height );
+    raster.perspective( fovy, width / double( height ), zNear, zFar );
+    std::vector<scene_file_t::light_t> lights = sceneLights();
+    const double3 &d = lights[0].direction;
+    double length = std::sqrt( d[0] * d[0] + d[1] * d[1] + d[2] * d[2] );
+    raster.light.direction = double3{ d[0] / length, d[1] / length, d[2] / length };
+    raster.light.ambient = 0.2f;                                        // GL's global ambient.
+    for ( auto &light : lights )
+        raster.light.ambient += light.ambient;
+    raster.light.diffuse = lights[0].diffuse;
+    return raster;
+}
+
+/*********************************************************************************
+* Draw the axes of drawFrame( len ) with the software rasterizer.
+**********************************************************************************/
+void drawFrameSoftware( soft_raster_t &raster, const mat4_t &modelView, float len ) {
+    raster.draw_line( double3{ 0, 0, 0 }, double3{ len, 0, 0 }, modelView, soft_raster_t::color_t{ 1, 0, 0, 1 } );
+    raster.draw_line( double3{ 0, 0, 0 }, double3{ 0, len, 0 }, modelView, soft_raster_t::color_t{ 0, 1, 0, 1 } );
+    raster.draw_line( double3{ 0, 0, 0 }, double3{ 0, 0, len }, modelView, soft_raster_t::color_t{ 0, 0, 1, 1 } );
+}
+
+/*********************************************************************************
+* Render the scene as display() does, with the software rasterizer.
+**********************************************************************************/
+void renderSoftware( soft_raster_t &raster, const soft_raster_t::texture_t &floorTexture ) {
+    raster.clear( 0, 0.6, 0.8 );
+    FrameXform wld2cam = FrameXform( scene.world( viewNode() ) ).inverse();
+    pick_view_t view{ scene.world( viewNode() ), width, height, fovy, zNear, zFar };
+    viewPlanes = region_planes( view, screen_point_t{ -0.5, -0.5 }, screen_point_t{ width - 0.5, height - 0.5 } );
+    culledCount = 0;
+
+    // Cameras, as setCamera() draws them.
+    for ( int i = 0; i < ( int )camNodes.size(); i++ ) {
+        if ( hiddenCamera( i ) )
+            continue;
+        if ( !frameInView( scene.world( camNodes[i] ), 5 )
+             && !box_in_planes( viewPlanes, scene.world( camModelNodes[i] ), cam->aabb.first, cam->aabb.second ) ) {
+            culledCount++;
+            continue;
+        }
+        drawFrameSoftware( raster, wld2cam * scene.world( camNodes[i] ), 5 );
+        mat4_t modelView = wld2cam * scene.world( camModelNodes[i] );
+        raster.draw_mesh( *camBuffers[camLevel( i, modelView )], modelView, soft_raster_t::color_t{ 0.2f, 0.2f, 0.2f, 1.0f }, true );
+    }
+
+    // Ground and floor, as drawFloor() draws them.
+    selectGround();
+    for ( auto &tile : groundTiles )
+        raster.draw_mesh( ground.grid(), wld2cam * ground.tile_matrix( tile ), soft_raster_t::color_t{ 0.35f, 0.2f, 0.1f, 1.0f }, false );
+    if ( frameInView( mat4_t(), 5 ) || box_in_planes( viewPlanes, mat4_t(), double3{ -12, -0.1, -12 }, double3{ 12, -0.1, 12 } ) ) {
+        raster.draw_polygon( { double3{ -12, -0.1, -12 }, double3{ 12, -0.1, -12 }, double3{ 12, -0.1, 12 }, double3{ -12, -0.1, 12 } },
+                             { double2{ 0, 0 }, double2{ 1, 0 }, double2{ 1, 1 }, double2{ 0, 1 } },
+                             wld2cam, soft_raster_t::color_t{ 1, 1, 1, 1 }, &floorTexture );
+        drawFrameSoftware( raster, wld2cam, 5 );
+    } else
+        culledCount++;
+
+    // Cow, as drawCow() draws it.
+    const mat4_t &cow2wld = scene.world( cowNode );
+    if ( frameInView( cow2wld, 5 ) || box_in_planes( viewPlanes, cow2wld, cow->aabb.first, cow->aabb.second ) ) {
+        drawFrameSoftware( raster, wld2cam * cow2wld, 5 );
+        raster.draw_mesh( *cowBuffer, wld2cam * cow2wld, sceneFile->instances[cowInstance].color, true );
+    } else
+        culledCount++;
+
+    // Scenery, as drawScenery() draws it.
+    for ( std::size_t i = 0; i < sceneryNodes.size(); i++ ) {
+        const scene_file_t::instance_t &instance = sceneFile->instances[sceneryInstances[i]];
+        const mat4_t &inst2wld = scene.world( sceneryNodes[i] );
+        const wavefront_obj_t &mesh = *sceneryMeshes[instance.mesh];
+        if ( box_in_planes( viewPlanes, inst2wld, mesh.aabb.first, mesh.aabb.second ) )
+            raster.draw_mesh( *sceneryBuffers[instance.mesh], wld2cam * inst2wld, instance.color, true );
+        else
+            culledCount++;
+    }
+}
+
+/*********************************************************************************
+* Headless mode: SimpleScene --headless script [output directory]
+* Renders frames with the software rasterizer; no window, GLUT or GPU is used.
+* Each frame is written as frame_0000.ppm, frame_0001.ppm, ... with its render time.
+* Script lines ('#' starts a comment):
+*   size w h                    viewport size, before the first frame (default 800 600)
+*   camera i                    view through camera i
+*   cow x y z angle ax ay az    place the cow at (x, y, z), turned angle degrees about (ax, ay, az)
+*   move x y z                  translate the cow in world space
+*   turn angle ax ay az         rotate the cow about an axis of its own frame
+*   frame [n]                   render n frames (default 1)
+*   fly n                       render n frames along the flythrough loop from the current camera
+**********************************************************************************/
+int runHeadless( const char *scriptPath, const std::string &outDir ) {
+    std::ifstream script( scriptPath );
+    if ( !script ) {
+        fprintf( stderr, "cannot open %s\n", scriptPath );
+        return 1;
+    }
+
+    loadCameras();
+    loadCow();
+    loadScenery();
+    soft_raster_t::texture_t floorTexture{ 8, 8, generate_texture( 8, 8, floorTexels( 8 ), false ).levels[0].rgb };
+    soft_raster_t raster = softRaster();
+
+    std::vector<double> times;
+    auto renderFrame = [&]() {
+        auto start = std::chrono::steady_clock::now();
+        renderSoftware( raster, floorTexture );
+        double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+        char name[32];
+        snprintf( name, sizeof( name ), "frame_%04d.ppm", ( int )times.size() );
+        std::string path = outDir + "/" + name;
+        if ( !raster.write_ppm( path ) ) {
+            fprintf( stderr, "cannot write %s\n", path.c_str() );
+            return false;
+        }
+        times.push_back( ms );
+        if ( flying )
+            printf( "%s: %.2f ms, flythrough %d, culled %d\n", path.c_str(), ms, ( int )flyFrame, culledCount );
+        else
+            printf( "%s: %.2f ms, camera %d, culled %d\n", path.c_str(), ms, cameraIndex, culledCount );
+        return true;
+    };
+
+    std::string line;
+    for ( int lineNumber = 1; std::getline( script, line ); lineNumber++ ) {
+        std::istringstream in( line.substr( 0, line.find( '#' ) ) );
+        std::string command;
+        if ( !( in >> command ) )
+            continue;
+
+        bool ok = true;
+        double v[7];
+        if ( command == "size" ) {
+            int w, h;
+            ok = ( in >> w >> h ) && w > 0 && h > 0 && times.empty();
+            if ( ok ) {
+                width = w;
+                height = h;
+                raster = softRaster();
+            }
+        } else if ( command == "camera" ) {
+            int i;
+            ok = ( in >> i ) && i >= 0 && i < ( int )camNodes.size();
+            if ( ok )
+                cameraIndex = i;
+        } else if ( command == "cow" ) {
+            ok = bool( in >> v[0] >> v[1] >> v[2] >> v[3] >> v[4] >> v[5] >> v[6] );
+            if ( ok )
+                setCowPose( rigid_xform_t::translate( v[0], v[1], v[2] ) * rigid_xform_t::rotate( v[3], v[4], v[5], v[6] ) );
+        } else if ( command == "move" ) {
+            ok = bool( in >> v[0] >> v[1] >> v[2] );
+            if ( ok )
+                setCowPose( rigid_xform_t::translate( v[0], v[1], v[2] ) * cowPose() );
+        } else if ( command == "turn" ) {
+            ok = bool( in >> v[0] >> v[1] >> v[2] >> v[3] );
+            if ( ok )
+                setCowPose( cowPose() * rigid_xform_t::rotate( v[0], v[1], v[2], v[3] ) );
+        } else if ( command == "frame" ) {
+            int count;
+            if ( !( in >> count ) )
+                count = 1;
+            for ( int k = 0; k < count; k++ ) {
+                if ( !renderFrame() )
+                    return 1;
+            }
+        } else if ( command == "fly" ) {
+            int count;
+            ok = ( in >> count ) && count > 0 && camNodes.size() >= 2;
+            if ( ok ) {
+                flyPoses = flythroughPath( count );     // precomputed, so the frames time drawing alone.
+                flying = true;
+                for ( flyFrame = 0; flyFrame < flyPoses.size(); flyFrame++ ) {
+                    scene.set_local( flyNode, flyPoses[flyFrame] );
+                    if ( !renderFrame() )
+                        return 1;
+                }
+                flying = false;
+            }
+        } else
+            ok = false;
+
+        if ( !ok ) {
+            fprintf( stderr, "%s:%d: cannot run '%s'\n", scriptPath, lineNumber, line.c_str() );
+            return 1;
+        }
+    }
+
+    if ( !times.empty() ) {
+        double total = 0;
+        for ( double ms : times )
+            total += ms;
+        printf( "%d frames at %dx%d: mean %.2f ms, min %.2f ms, max %.2f ms (%.1f frames per second)\n",
+                ( int )times.size(), width, height, total / times.size(),
+                *std::min_element( times.begin(), times.end() ), *std::max_element( times.begin(), times.end() ),
+                1000 * times.size() / total );
+    }
+    return 0;
+}
+
+/*********************************************************************************
+* Feed every event of replayLog recorded up to 'elapsed' seconds into the handler
+* GLUT would have called, as if it had just arrived.
+**********************************************************************************/
+void replayInput( double elapsed ) {
+    for ( ; replayNext < replayLog.events.size() && replayLog.events[replayNext].time <= elapsed; replayNext++ ) {
+        const input_event_t &event = replayLog.events[replayNext];
+        replayEvent = &event;
+        replayLatency.dispatched( event );
+        switch ( event.kind ) {
+        case input_event_t::reshape:
+            if ( headless ) {
+                width = event.x;                                    // The replay loop resizes its raster before the next frame.
+                height = event.y;
+                redisplayPending = true;
+            } else
+                glutReshapeWindow( event.x, event.y );
+            break;
+        case input_event_t::key:
+            onKeyPress( ( unsigned char )event.code, event.x, event.y );
+            break;
+        case input_event_t::button:
+            onMouseButton( event.code, event.state, event.x, event.y );
+            break;
+        case input_event_t::motion:
+            onMouseDrag( event.x, event.y );
+            break;
+        }
+    }
+    replayEvent = nullptr;
+}
+
+/*********************************************************************************
+* Windowed replay: a GLUT timer wakes for each recorded event in real time.
+* display() reports the latencies after the frame showing the last event.
+**********************************************************************************/
+void onReplayTimer( int ) {
+    replayInput( std::chrono::duration<double>( std::chrono::steady_clock::now() - replayStart ).count() );
+    if ( replayNext < replayLog.events.size() ) {
+        double wait = replayLog.events[replayNext].time - std::chrono::duration<double>( std::chrono::steady_clock::now() - replayStart ).count();
+        glutTimerFunc( unsigned( std::max( 0.0, wait * 1000 ) ), onReplayTimer, 0 );
+    } else
+        glutPostRedisplay();                                        // Make sure a frame follows the last event.
 }
 
-void spinCow(void) {
-	glutIdleFunc(spinCow);
-	glPushMatrix();
-	glLoadIdentity();
-	glMultMatrixd(cow2wld.matrix());
-	glRotated(0.1, rotx, roty, rotz);
-	glGetDoublev(GL_MODELVIEW_MATRIX, cow2wld.matrix());
-	glPopMatrix();
+/*********************************************************************************
+* Headless replay: SimpleScene --headless-replay log [output directory]
+* Time is simulated in 60 Hz frames, so a replay does the same work every run:
+* each frame feeds the events recorded before it, steps the animations and, if
+* anything asked for a redraw, renders in software. Latency is the real time
+* from feeding an event to finishing its frame, which is the cost of handling
+* and drawing it. Frames are written only when an output directory is given.
+**********************************************************************************/
+int runReplayHeadless( const char *logPath, const std::string &outDir ) {
+    try {
+        replayLog.load( logPath );
+    } catch ( std::runtime_error &error ) {
+        fprintf( stderr, "%s: %s\n", logPath, error.what() );
+        return 1;
+    }
+
+    headless = true;
+    loadCameras();
+    loadCow();
+    loadScenery();
+    soft_raster_t::texture_t floorTexture{ 8, 8, generate_texture( 8, 8, floorTexels( 8 ), false ).levels[0].rgb };
+    soft_raster_t raster = softRaster();
+
+    const double frameInterval = 1.0 / 60;
+    int frames = 0;
+    double renderMs = 0;
+    replayStart = std::chrono::steady_clock::now();
+    for ( int tick = 0; replayNext < replayLog.events.size() || redisplayPending; tick++ ) {
+        headlessNow = replayStart + std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::duration<double>( tick * frameInterval ) );
+        replayInput( tick * frameInterval );
+        if ( animator.advance( headlessNow ) > 0 )
+            redisplayPending = true;
+        if ( !redisplayPending )
+            continue;
+        redisplayPending = false;
+
+        if ( raster.width != width || raster.height != height ) {
+            raster = softRaster();
+        }
+        auto start = std::chrono::steady_clock::now();
+        applyDrag();                                                // as display() does before drawing.
+        renderSoftware( raster, floorTexture );
+        replayLatency.presented();
+        renderMs += std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+        if ( !outDir.empty() ) {
+            char name[32];
+            snprintf( name, sizeof( name ), "frame_%04d.ppm", frames );
+            if ( !raster.write_ppm( outDir + "/" + name ) ) {
+                fprintf( stderr, "cannot write %s/%s\n", outDir.c_str(), name );
+                return 1;
+            }
+        }
+        frames++;
+    }
 
-	glutPostRedisplay();
+    printf( "replayed %d events over %.2f s of input: %d frames at %dx%d, %.2f ms per frame\n",
+            ( int )replayLog.events.size(), replayLog.events.empty() ? 0.0 : replayLog.events.back().time,
+            frames, width, height, frames ? renderMs / frames : 0.0 );
+    replayLatency.print( std::cout );
+    return 0;
 }
 
 int main( int argc, char *argv[] ) {
     width = 800;
     height = 600;
     frame = 0;
+    // --scene path, --no-mesh-cache and --verbose come first, in any order.
+    while ( argc > 1 ) {
+        int used = 0;
+        if ( std::string( argv[1] ) == "--verbose" ) {
+            verbose = true;
+            used = 1;
+        } else if ( std::string( argv[1] ) == "--no-mesh-cache" ) {
+            meshCache = false;
+            used = 1;
+        } else if ( argc > 2 && std::string( argv[1] ) == "--scene" ) {
+            scenePath = argv[2];
+            used = 2;
+        } else
+            break;
+        argv[used] = argv[0];                       // Drop the option; the rest reads as if it was not given.
+        argv += used;
+        argc -= used;
+    }
+    try {
+        sceneFile = new scene_file_t( scenePath );
+        if ( sceneFile->camera_mesh < 0 || sceneFile->cameras.empty() )
+            throw std::runtime_error( "The scene needs a camera_model and a camera." );
+        if ( ( cowInstance = sceneFile->find_instance( "cow" ) ) < 0 )
+            throw std::runtime_error( "The scene has no instance named cow." );
+    } catch ( std::runtime_error &error ) {
+        fprintf( stderr, "%s: %s\n", scenePath, error.what() );
+        return 1;
+    }
+    for ( auto &mesh : sceneFile->meshes )
+        assets.load_async( mesh.asset_key() );             // Start reading every model at once, in the background while GL is set up.
+    cowNode = scene.add_node( scene_graph_t::none, rigid_xform_t(), "cow" );    // Placed once the cow is loaded, in loadCow().
+
+    // Render a script of frames in software and exit, without opening a window.
+    if ( argc > 1 && std::string( argv[1] ) == "--headless" ) {
+        if ( argc < 3 ) {
+            printf( "usage: %s --headless script [output directory]\n", argv[0] );
+            return 1;
+        }
+        return runHeadless( argv[2], argc > 3 ? argv[3] : "." );
+    }
+    if ( argc > 1 && std::string( argv[1] ) == "--headless-replay" ) {
+        if ( argc < 3 ) {
+            printf( "usage: %s --headless-replay log [output directory]\n", argv[0] );
+            return 1;
+        }
+        return runReplayHeadless( argv[2], argc > 3 ? argv[3] : "" );
+    }
+
+    // Record the input of this session to a log, or replay one into the window.
+    if ( argc > 2 && std::string( argv[1] ) == "--record" ) {
+        try {
+            inputRecorder = new input_recorder_t( argv[2] );
+        } catch ( std::runtime_error &error ) {
+            fprintf( stderr, "%s: %s\n", argv[2], error.what() );
+            return 1;
+        }
+    } else if ( argc > 2 && std::string( argv[1] ) == "--replay" ) {
+        try {
+            replayLog.load( argv[2] );
+        } catch ( std::runtime_error &error ) {
+            fprintf( stderr, "%s: %s\n", argv[2], error.what() );
+            return 1;
+        }
+    }
+
     glutInit( &argc, argv );                        // Initialize openGL.
     glutInitDisplayMode( GLUT_DOUBLE | GLUT_RGB );  // Initialize display mode. This project will use double buffer and RGB color.
     glutInitWindowSize( width, height );                // Initialize window size.
@@ -555,6 +1472,10 @@ int main( int argc, char *argv[] ) {
     glGetIntegerv( GL_BLUE_BITS, &bv );             // Get the depth of blue bits from GL.
     printf( "Pixel depth = %d : %d : %d\n", rv, gv, bv );
     initialize();                                   // Initialize the other thing.
+    if ( !replayLog.events.empty() ) {
+        replayStart = std::chrono::steady_clock::now();
+        glutTimerFunc( unsigned( replayLog.events[0].time * 1000 ), onReplayTimer, 0 );
+    }
     glutMainLoop();                                 // Execute the loop which handles events.
 
     return 0;
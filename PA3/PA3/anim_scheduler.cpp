@@ -0,0 +1,53 @@
+#include <cmath>
+#include <algorithm>
+#include "anim_scheduler.h"
+
+anim_scheduler_t::anim_scheduler_t( double step_seconds, double frames_per_second, int max_steps_per_frame )
+    : step( step_seconds ), frame_interval( 1 / frames_per_second ), max_steps( std::max( 1, max_steps_per_frame ) ) {}
+
+int anim_scheduler_t::start( task_t task, clock_type::time_point now ) {
+    if ( tasks.empty() ) {
+        last = now;
+        next_frame = now;
+        accumulated = 0;
+    }
+    tasks.emplace_back( next_id, std::move( task ) );
+    return next_id++;
+}
+
+void anim_scheduler_t::stop( int id ) {
+    tasks.erase( std::remove_if( tasks.begin(), tasks.end(),
+                                 [id]( const std::pair<int, task_t> &t ) { return t.first == id; } ),
+                 tasks.end() );
+}
+
+int anim_scheduler_t::advance( clock_type::time_point now ) {
+    if ( tasks.empty() ) {
+        last = now;
+        return 0;
+    }
+
+    accumulated += std::chrono::duration<double>( now - last ).count();
+    last = now;
+    int steps = 0;
+    while ( accumulated >= step && steps < max_steps ) {
+        for ( auto &task : tasks )
+            task.second( step );
+        accumulated -= step;
+        ++steps;
+    }
+    if ( accumulated >= step ) {
+        dropped += std::uint64_t( accumulated / step );
+        accumulated = std::fmod( accumulated, step );
+    }
+    total_steps += steps;
+    return steps;
+}
+
+int anim_scheduler_t::frame_delay_ms( clock_type::time_point now ) {
+    auto interval = std::chrono::duration_cast<clock_type::duration>( std::chrono::duration<double>( frame_interval ) );
+    next_frame += interval;
+    if ( next_frame < now )
+        next_frame = now + interval;    // fell behind: restart the grid instead of rushing to catch up
+    return int( std::chrono::duration_cast<std::chrono::milliseconds>( next_frame - now ).count() );
+}
@@ -0,0 +1,71 @@
+#ifndef _ANIM_SCHEDULER_H_
+#define _ANIM_SCHEDULER_H_
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <utility>
+#include <functional>
+
+// Fixed-timestep animation, decoupled from drawing. Running tasks advance in
+// steps of exactly step_seconds however often frames are drawn, so motion is
+// the same at any frame rate and replays identically. Frames are paced on a
+// fixed grid of the target rate, and when no task runs there is nothing to
+// schedule, so the caller can leave the event loop asleep.
+class anim_scheduler_t {
+public:
+	using clock_type = std::chrono::steady_clock;
+	using task_t = std::function<void( double dt )>;   // dt is always step_seconds
+
+	explicit anim_scheduler_t( double step_seconds = 1.0 / 120, double frames_per_second = 60,
+	                           int max_steps_per_frame = 8 );
+
+	// Run task every step from now on and return its id. Time spent idle
+	// before the first task starts is not caught up.
+	int start( task_t task, clock_type::time_point now = clock_type::now() );
+
+	// Stop the task with the given id; unknown ids are ignored. Must not be
+	// called from inside a task.
+	void stop( int id );
+
+	bool animating() const {
+		return !tasks.empty();
+	}
+
+	// Run every step due by now and return how many ran. When more than
+	// max_steps_per_frame are due (a stall, a breakpoint), the rest of the
+	// backlog is dropped rather than replayed in a burst.
+	int advance( clock_type::time_point now = clock_type::now() );
+
+	// Milliseconds from now until the next frame is due.
+	int frame_delay_ms( clock_type::time_point now = clock_type::now() );
+
+	// Fraction of a step simulated time lags real time, for interpolating
+	// poses between the last two steps.
+	double interpolation() const {
+		return accumulated / step;
+	}
+
+	double step_seconds() const {
+		return step;
+	}
+
+	std::uint64_t steps_run() const {
+		return total_steps;
+	}
+
+	std::uint64_t steps_dropped() const {
+		return dropped;
+	}
+
+private:
+	double step, frame_interval;
+	int max_steps;
+	std::vector<std::pair<int, task_t>> tasks;
+	int next_id = 0;
+	double accumulated = 0;             // real time not yet simulated, in seconds
+	clock_type::time_point last, next_frame;
+	std::uint64_t total_steps = 0, dropped = 0;
+};
+
+#endif // _ANIM_SCHEDULER_H_
@@ -0,0 +1,146 @@
+#ifndef _ASSET_CACHE_H_
+#define _ASSET_CACHE_H_
+
+#include <map>
+#include <string>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include "parallel.h"
+
+// Loads every asset at most once and hands out shared handles to it.
+//   - load() and load_async() for the same path share one instance, even while
+//     the first load is still running on the worker threads.
+//   - an asset is in use while any handle to it is alive; the cache keeps its
+//     own reference, so dropping every handle does not unload it.
+//   - when the loaded assets exceed the memory budget, unused ones are evicted,
+//     least recently requested first. Assets in use are never evicted.
+// T must be constructible from a path (const char *) and provide
+// std::size_t memory_size() const, unless a loader is given.
+template<class T>
+class asset_cache_t {
+public:
+    using handle_t = std::shared_ptr<T>;
+    using loader_t = std::function<handle_t( const std::string &path )>;
+
+    explicit asset_cache_t( std::size_t budget_bytes = std::size_t( 256 ) << 20,
+                            std::size_t threads = 2,
+                            loader_t loader = default_loader )
+        : budget( budget_bytes ), loader( std::move( loader ) ), pool( threads ) {}
+
+    asset_cache_t( const asset_cache_t & ) = delete;
+    asset_cache_t &operator=( const asset_cache_t & ) = delete;
+
+    // Start loading path on a worker thread unless it is cached or loading.
+    // The future rethrows the loader's exception; failed loads are not cached.
+    std::shared_future<handle_t> load_async( const std::string &path ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        auto found = entries.find( path );
+        if ( found != entries.end() ) {
+            found->second.last_use = ++clock;
+            return found->second.asset;
+        }
+
+        entry_t &entry = entries[path];
+        entry.last_use = ++clock;
+        entry.asset = pool.submit( [this, path]() {
+            handle_t asset;
+            try {
+                asset = loader( path );
+            } catch ( ... ) {
+                std::lock_guard<std::mutex> lock( mutex );
+                entries.erase( path );
+                throw;
+            }
+            std::lock_guard<std::mutex> lock( mutex );
+            auto e = entries.find( path );
+            if ( e != entries.end() ) {
+                e->second.bytes = asset->memory_size();
+                used += e->second.bytes;
+                evict();
+            }
+            return asset;
+        } ).share();
+        return entry.asset;
+    }
+
+    // Blocking load; throws what the loader throws.
+    handle_t load( const std::string &path ) {
+        return load_async( path ).get();
+    }
+
+    // Evict unused assets until the cache fits in budget_bytes.
+    void set_budget( std::size_t budget_bytes ) {
+        std::lock_guard<std::mutex> lock( mutex );
+        budget = budget_bytes;
+        evict();
+    }
+
+    // Drop every asset that no handle refers to.
+    void clear_unused() {
+        std::lock_guard<std::mutex> lock( mutex );
+        for ( auto e = entries.begin(); e != entries.end(); ) {
+            if ( is_unused( e->second ) ) {
+                used -= e->second.bytes;
+                e = entries.erase( e );
+            } else {
+                ++e;
+            }
+        }
+    }
+
+    std::size_t memory_used() const {
+        std::lock_guard<std::mutex> lock( mutex );
+        return used;
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock( mutex );
+        return entries.size();
+    }
+
+private:
+    struct entry_t {
+        std::shared_future<handle_t> asset;
+        std::size_t bytes = 0;          // counted in used once loaded
+        std::uint64_t last_use = 0;
+    };
+
+    mutable std::mutex mutex;
+    std::map<std::string, entry_t> entries;
+    std::size_t budget, used = 0;
+    std::uint64_t clock = 0;
+    loader_t loader;
+    thread_pool_t pool;                 // last member: its workers stop before the rest is destroyed
+
+    static handle_t default_loader( const std::string &path ) {
+        return std::make_shared<T>( path.c_str() );
+    }
+
+    // Loaded, and only the cache's own reference is left.
+    static bool is_unused( const entry_t &entry ) {
+        if ( entry.asset.wait_for( std::chrono::seconds( 0 ) ) != std::future_status::ready )
+            return false;
+        return entry.asset.get().use_count() == 1;
+    }
+
+    // Caller holds mutex.
+    void evict() {
+        while ( used > budget ) {
+            auto victim = entries.end();
+            for ( auto e = entries.begin(); e != entries.end(); ++e ) {
+                if ( is_unused( e->second ) && ( victim == entries.end() || e->second.last_use < victim->second.last_use ) )
+                    victim = e;
+            }
+            if ( victim == entries.end() )
+                return;
+            used -= victim->second.bytes;
+            entries.erase( victim );
+        }
+    }
+};
+
+#endif // _ASSET_CACHE_H_
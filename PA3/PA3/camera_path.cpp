@@ -0,0 +1,148 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "camera_path.h"
+
+namespace {
+
+using double3 = camera_path_t::double3;
+
+// Samples per segment when measuring the path's length for bake().
+const int length_samples = 64;
+
+double dot( const quat_t &a, const quat_t &b ) {
+    return a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+quat_t aligned( const quat_t &q, const quat_t &to ) {
+    return dot( q, to ) < 0 ? quat_t( -q.w, -q.x, -q.y, -q.z ) : q;
+}
+
+// Spherical interpolation along the arc from a to b as given, even when it is
+// the long way round. Squad needs this: its blend between the two inner
+// interpolations must not flip sides as their dot product changes sign.
+quat_t slerp_arc( const quat_t &a, const quat_t &b, double t ) {
+    double c = std::min( 1.0, std::max( -1.0, dot( a, b ) ) );
+    double ka = 1 - t, kb = t;
+    if ( std::fabs( c ) < 0.9995 ) {
+        double angle = std::acos( c ), s = std::sin( angle );
+        ka = std::sin( ka * angle ) / s;
+        kb = std::sin( kb * angle ) / s;
+    }
+    return quat_t( ka * a.w + kb * b.w, ka * a.x + kb * b.x, ka * a.y + kb * b.y, ka * a.z + kb * b.z ).normalized();
+}
+
+// Logarithm of a unit quaternion: ( 0, axis * half angle ).
+quat_t quat_log( const quat_t &q ) {
+    double s = std::sqrt( q.x * q.x + q.y * q.y + q.z * q.z );
+    double k = s < 1e-12 ? 1 : std::atan2( s, q.w ) / s;
+    return quat_t( 0, q.x * k, q.y * k, q.z * k );
+}
+
+quat_t quat_exp( const quat_t &q ) {
+    double a = std::sqrt( q.x * q.x + q.y * q.y + q.z * q.z );
+    double k = a < 1e-12 ? 1 : std::sin( a ) / a;
+    return quat_t( std::cos( a ), q.x * k, q.y * k, q.z * k );
+}
+
+double distance( const double3 &a, const double3 &b ) {
+    return std::sqrt( ( a[0] - b[0] ) * ( a[0] - b[0] ) + ( a[1] - b[1] ) * ( a[1] - b[1] ) + ( a[2] - b[2] ) * ( a[2] - b[2] ) );
+}
+
+double3 lerp( const double3 &a, const double3 &b, double ta, double tb, double t ) {
+    double k = tb == ta ? 0 : ( t - ta ) / ( tb - ta );
+    return double3{ { a[0] + k * ( b[0] - a[0] ), a[1] + k * ( b[1] - a[1] ), a[2] + k * ( b[2] - a[2] ) } };
+}
+
+// Centripetal Catmull-Rom between p1 (f = 0) and p2 (f = 1), by Barry and Goldman's pyramid.
+double3 catmull_rom( const double3 &p0, const double3 &p1, const double3 &p2, const double3 &p3, double f ) {
+    double t0 = 0;
+    double t1 = t0 + std::sqrt( distance( p0, p1 ) );
+    double t2 = t1 + std::sqrt( distance( p1, p2 ) );
+    double t3 = t2 + std::sqrt( distance( p2, p3 ) );
+    if ( t2 == t1 )
+        return p1;
+    double t = t1 + f * ( t2 - t1 );
+    double3 a1 = lerp( p0, p1, t0, t1, t ), a2 = lerp( p1, p2, t1, t2, t ), a3 = lerp( p2, p3, t2, t3, t );
+    double3 b1 = lerp( a1, a2, t0, t2, t ), b2 = lerp( a2, a3, t1, t3, t );
+    return lerp( b1, b2, t1, t2, t );
+}
+
+} // namespace
+
+camera_path_t::camera_path_t( const std::vector<rigid_xform_t> &keys, bool closed ) : keys( keys ), closed( closed ) {
+    if ( keys.size() < 2 )
+        throw std::runtime_error( "A camera path needs two keys." );
+
+    int n = int( keys.size() );
+    for ( int i = 0; i < n; i++ )
+        rotations.push_back( i == 0 ? keys[0].rotation : aligned( keys[i].rotation, rotations.back() ) );
+
+    // Squad control point of key i: q * exp( -( log( q^-1 next ) + log( q^-1 prev ) ) / 4 ).
+    for ( int i = 0; i < n; i++ ) {
+        const quat_t &q = rotations[i];
+        if ( !closed && ( i == 0 || i == n - 1 ) ) {
+            controls.push_back( q );
+            continue;
+        }
+        quat_t next = aligned( rotations[( i + 1 ) % n], q ), prev = aligned( rotations[( i + n - 1 ) % n], q );
+        quat_t a = quat_log( q.conjugate() * next ), b = quat_log( q.conjugate() * prev );
+        controls.push_back( ( q * quat_exp( quat_t( 0, -( a.x + b.x ) / 4, -( a.y + b.y ) / 4, -( a.z + b.z ) / 4 ) ) ).normalized() );
+    }
+}
+
+camera_path_t::double3 camera_path_t::point( int i ) const {
+    int n = int( keys.size() );
+    if ( closed )
+        return keys[( i % n + n ) % n].translation;
+    if ( i >= 0 && i < n )
+        return keys[i].translation;
+
+    // Reflect the neighbouring key through the end one.
+    const double3 &end = keys[i < 0 ? 0 : n - 1].translation, &inner = keys[i < 0 ? 1 : n - 2].translation;
+    return double3{ { 2 * end[0] - inner[0], 2 * end[1] - inner[1], 2 * end[2] - inner[2] } };
+}
+
+rigid_xform_t camera_path_t::pose( double u ) const {
+    u = std::min( std::max( u, 0.0 ), double( segments() ) );
+    int i = std::min( int( u ), segments() - 1 ), j = ( i + 1 ) % int( keys.size() );
+    double f = u - i;
+
+    double3 p = catmull_rom( point( i - 1 ), point( i ), point( i + 1 ), point( i + 2 ), f );
+
+    // Keep both ends and their control points on one side, which only the
+    // segment closing a loop can be off.
+    const quat_t &qi = rotations[i], &si = controls[i];
+    quat_t qj = rotations[j], sj = controls[j];
+    if ( dot( qi, qj ) < 0 ) {
+        qj = quat_t( -qj.w, -qj.x, -qj.y, -qj.z );
+        sj = quat_t( -sj.w, -sj.x, -sj.y, -sj.z );
+    }
+    quat_t q = slerp_arc( slerp_arc( qi, qj, f ), slerp_arc( si, sj, f ), 2 * f * ( 1 - f ) );
+    return rigid_xform_t( q, p, keys[i].scale + f * ( keys[j].scale - keys[i].scale ) );
+}
+
+std::vector<rigid_xform_t> camera_path_t::bake( int count, double turn_radius ) const {
+    // Cumulative length at length_samples points per segment.
+    int samples = segments() * length_samples;
+    std::vector<double> length( samples + 1, 0 );
+    rigid_xform_t last = pose( 0 );
+    for ( int k = 1; k <= samples; k++ ) {
+        rigid_xform_t next = pose( double( k ) / length_samples );
+        double turn = 2 * std::acos( std::min( 1.0, std::fabs( dot( last.rotation, next.rotation ) ) ) );
+        length[k] = length[k - 1] + distance( last.translation, next.translation ) + turn_radius * turn;
+        last = next;
+    }
+
+    std::vector<rigid_xform_t> poses;
+    int steps = closed ? count : count - 1;
+    for ( int frame = 0; frame < count; frame++ ) {
+        double target = steps > 0 ? length.back() * frame / steps : 0;
+        int k = int( std::upper_bound( length.begin(), length.end(), target ) - length.begin() ) - 1;
+        k = std::min( std::max( k, 0 ), samples - 1 );
+        double span = length[k + 1] - length[k];
+        double f = span > 0 ? ( target - length[k] ) / span : 0;
+        poses.push_back( pose( ( k + f ) / length_samples ) );
+    }
+    return poses;
+}
@@ -0,0 +1,41 @@
+#ifndef _CAMERA_PATH_H_
+#define _CAMERA_PATH_H_
+
+#include <vector>
+#include "rigid_xform.h"
+
+// Smooth path through a sequence of camera poses (cam2wld) for flythroughs.
+// Positions follow a centripetal Catmull-Rom spline, which passes through
+// every key without the loops or overshoot a uniform one makes between keys
+// of very different spacing. Orientations follow a squad spline, so the
+// turning rate has no jumps at the keys as it would with plain slerp.
+class camera_path_t {
+public:
+	using double3 = rigid_xform_t::double3;
+
+	// Needs at least two keys. A closed path runs from the last key back to the first.
+	camera_path_t( const std::vector<rigid_xform_t> &keys, bool closed );
+
+	int segments() const {
+		return int( closed ? keys.size() : keys.size() - 1 );
+	}
+
+	// Pose at u in 0..segments(): key floor( u ), blending into the next one.
+	rigid_xform_t pose( double u ) const;
+
+	// count poses spread evenly along the path, the first at the first key.
+	// A closed path does not repeat the first pose at the end, so the poses
+	// can be looped; an open one ends at its last key. Spacing counts the
+	// distance moved plus turn_radius units per radian turned, so a camera
+	// that turns on the spot still takes time to do it.
+	std::vector<rigid_xform_t> bake( int count, double turn_radius = 10 ) const;
+
+private:
+	std::vector<rigid_xform_t> keys;
+	std::vector<quat_t> rotations, controls;    // keys' rotations in one hemisphere, and their squad control points
+	bool closed;
+
+	double3 point( int i ) const;               // key position, extended past the ends of an open path
+};
+
+#endif // _CAMERA_PATH_H_
@@ -0,0 +1,162 @@
+#include <cstddef>
+#include <cstdint>
+#include <GL/glut.h>
+#ifndef _WIN32
+#include <GL/glx.h>
+#endif
+#include "gl_mesh.h"
+
+// Buffer objects are OpenGL 1.5, newer than the 1.1 headers and libraries
+// on Windows, so their entry points are looked up at run time.
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STATIC_DRAW 0x88E4
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+namespace {
+
+typedef void ( APIENTRY *gen_buffers_t )( GLsizei n, GLuint *buffers );
+typedef void ( APIENTRY *delete_buffers_t )( GLsizei n, const GLuint *buffers );
+typedef void ( APIENTRY *bind_buffer_t )( GLenum target, GLuint buffer );
+typedef void ( APIENTRY *buffer_data_t )( GLenum target, std::ptrdiff_t size, const void *data, GLenum usage );
+
+struct buffer_procs_t {
+    gen_buffers_t gen_buffers;
+    delete_buffers_t delete_buffers;
+    bind_buffer_t bind_buffer;
+    buffer_data_t buffer_data;
+
+    bool available() const {
+        return gen_buffers && delete_buffers && bind_buffer && buffer_data;
+    }
+};
+
+void *proc_address( const char *name ) {
+#ifdef _WIN32
+    return ( void * )wglGetProcAddress( name );
+#else
+    return ( void * )glXGetProcAddressARB( ( const GLubyte * )name );
+#endif
+}
+
+// Looked up on first use, when a context is current.
+const buffer_procs_t &buffer_procs() {
+    static const buffer_procs_t procs = {
+        ( gen_buffers_t )proc_address( "glGenBuffers" ),
+        ( delete_buffers_t )proc_address( "glDeleteBuffers" ),
+        ( bind_buffer_t )proc_address( "glBindBuffer" ),
+        ( buffer_data_t )proc_address( "glBufferData" ),
+    };
+    return procs;
+}
+
+const void *address( std::uintptr_t p ) {
+    return reinterpret_cast<const void *>( p );
+}
+
+}
+
+gl_mesh_t::gl_mesh_t( const mesh_buffer_t &buffer ) : buffer( buffer ) {
+    const buffer_procs_t &gl = buffer_procs();
+    if ( !gl.available() || buffer.indices.empty() )
+        return;
+
+    GLuint ids[2];
+    gl.gen_buffers( 2, ids );
+    vertex_buffer = ids[0];
+    index_buffer = ids[1];
+    gl.bind_buffer( GL_ARRAY_BUFFER, vertex_buffer );
+    gl.buffer_data( GL_ARRAY_BUFFER, buffer.vertices.size() * sizeof( mesh_buffer_t::vertex_t ), buffer.vertices.data(), GL_STATIC_DRAW );
+    gl.bind_buffer( GL_ELEMENT_ARRAY_BUFFER, index_buffer );
+    gl.buffer_data( GL_ELEMENT_ARRAY_BUFFER, buffer.indices.size() * sizeof( std::uint32_t ), buffer.indices.data(), GL_STATIC_DRAW );
+    gl.bind_buffer( GL_ARRAY_BUFFER, 0 );
+    gl.bind_buffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+}
+
+gl_mesh_t::~gl_mesh_t() {
+    if ( vertex_buffer ) {
+        GLuint ids[2] = { vertex_buffer, index_buffer };
+        buffer_procs().delete_buffers( 2, ids );
+    }
+}
+
+void gl_mesh_t::draw() const {
+    if ( buffer.indices.empty() )
+        return;
+    bind();
+    draw_ranges( true );
+    unbind();
+}
+
+void gl_mesh_t::draw_instances( const std::vector<instance_t> &instances ) const {
+    if ( buffer.indices.empty() || instances.empty() )
+        return;
+
+    const GLfloat no_specular[4] = { 0, 0, 0, 1 };
+    glPushAttrib( GL_ENABLE_BIT | GL_LIGHTING_BIT | GL_CURRENT_BIT );
+    glColorMaterial( GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE );      // the instance color stands in for the material
+    glPushMatrix();
+    bind();
+    for ( auto &instance : instances ) {
+        glLoadMatrixd( instance.model_view.m );
+        glColor4fv( instance.color.data() );
+        if ( instance.materials ) {
+            // Start from the instance color, for the ranges before the first material.
+            glDisable( GL_COLOR_MATERIAL );
+            glMaterialfv( GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE, instance.color.data() );
+            glMaterialfv( GL_FRONT_AND_BACK, GL_SPECULAR, no_specular );
+            glMaterialf( GL_FRONT_AND_BACK, GL_SHININESS, 0 );
+        } else
+            glEnable( GL_COLOR_MATERIAL );
+        draw_ranges( instance.materials );
+    }
+    unbind();
+    glPopMatrix();
+    glPopAttrib();
+}
+
+// With buffers bound, the array pointers are offsets into them.
+void gl_mesh_t::bind() const {
+    std::uintptr_t vertices = reinterpret_cast<std::uintptr_t>( buffer.vertices.data() );
+    if ( vertex_buffer ) {
+        buffer_procs().bind_buffer( GL_ARRAY_BUFFER, vertex_buffer );
+        buffer_procs().bind_buffer( GL_ELEMENT_ARRAY_BUFFER, index_buffer );
+        vertices = 0;
+    }
+
+    const GLsizei stride = sizeof( mesh_buffer_t::vertex_t );
+    glPushClientAttrib( GL_CLIENT_VERTEX_ARRAY_BIT );
+    glEnableClientState( GL_VERTEX_ARRAY );
+    glEnableClientState( GL_NORMAL_ARRAY );
+    glEnableClientState( GL_TEXTURE_COORD_ARRAY );
+    glVertexPointer( 3, GL_FLOAT, stride, address( vertices + offsetof( mesh_buffer_t::vertex_t, position ) ) );
+    glNormalPointer( GL_FLOAT, stride, address( vertices + offsetof( mesh_buffer_t::vertex_t, normal ) ) );
+    glTexCoordPointer( 2, GL_FLOAT, stride, address( vertices + offsetof( mesh_buffer_t::vertex_t, texcoord ) ) );
+}
+
+void gl_mesh_t::draw_ranges( bool materials ) const {
+    std::uintptr_t indices = vertex_buffer ? 0 : reinterpret_cast<std::uintptr_t>( buffer.indices.data() );
+    for ( auto &range : buffer.ranges ) {
+        if ( materials && range.material >= 0 ) {
+            const wavefront_obj_t::material_t &m = buffer.materials[range.material];
+            glMaterialfv( GL_FRONT_AND_BACK, GL_AMBIENT, m.ambient.data() );
+            glMaterialfv( GL_FRONT_AND_BACK, GL_DIFFUSE, m.diffuse.data() );
+            glMaterialfv( GL_FRONT_AND_BACK, GL_SPECULAR, m.specular.data() );
+            glMaterialf( GL_FRONT_AND_BACK, GL_SHININESS, m.shininess );
+        }
+        glDrawElements( GL_TRIANGLES, GLsizei( range.index_count ), GL_UNSIGNED_INT,
+                        address( indices + range.index_begin * sizeof( std::uint32_t ) ) );
+    }
+}
+
+void gl_mesh_t::unbind() const {
+    glPopClientAttrib();
+    if ( vertex_buffer ) {
+        buffer_procs().bind_buffer( GL_ARRAY_BUFFER, 0 );
+        buffer_procs().bind_buffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef _GL_MESH_H_
+#define _GL_MESH_H_
+
+#include <vector>
+#include <array>
+#include "mat4.h"
+#include "mesh_buffer.h"
+
+// A mesh_buffer_t uploaded once into a vertex buffer and an index buffer,
+// drawn with one glDrawElements per material range. Where the driver has no
+// buffer objects (before OpenGL 1.5) the same call reads client-side arrays
+// straight from the mesh_buffer_t instead. The buffer must outlive this
+// object, and a GL context must be current for all of it.
+class gl_mesh_t {
+public:
+	// One copy of the mesh in draw_instances().
+	struct instance_t {
+		mat4_t model_view;
+		std::array<float, 4> color;     // current color, and ambient and diffuse when lit
+		bool materials = false;         // keep the ranges' own materials; color lights only the rest
+	};
+
+	explicit gl_mesh_t( const mesh_buffer_t &buffer );
+	~gl_mesh_t();
+
+	gl_mesh_t( const gl_mesh_t & ) = delete;
+	gl_mesh_t &operator=( const gl_mesh_t & ) = delete;
+
+	// Draw with the current matrices, color and lighting, setting the
+	// materials of the ranges that have one.
+	void draw() const;
+
+	// Draw every instance with the buffers bound and the arrays set up once.
+	// Fixed-function GL has no per-instance attributes, so each instance
+	// still loads its matrix and color, then issues its indexed draws. The
+	// modelview matrix is restored afterwards.
+	void draw_instances( const std::vector<instance_t> &instances ) const;
+
+	// True when the data lives in GL buffer objects.
+	bool uses_buffers() const {
+		return vertex_buffer != 0;
+	}
+
+private:
+	const mesh_buffer_t &buffer;
+	unsigned vertex_buffer = 0, index_buffer = 0;
+
+	void bind() const;
+	void draw_ranges( bool materials ) const;
+	void unbind() const;
+};
+
+#endif // _GL_MESH_H_
@@ -0,0 +1,78 @@
+#include <cmath>
+#include <algorithm>
+#include "scene_pick.h"
+#include "ground_tiles.h"
+
+namespace {
+
+const float skirt_depth = 0.05f;
+
+} // namespace
+
+ground_tiles_t::ground_tiles_t( double half_extent, double y, double min_tile, double lod_distance, int grid )
+    : half_extent( half_extent ), y( y ), min_tile( min_tile ), lod_distance( lod_distance ) {
+    // Top grid: vertex (i, j) at x = i / grid, z = j / grid.
+    const int side = grid + 1;
+    for ( int j = 0; j < side; j++ ) {
+        for ( int i = 0; i < side; i++ ) {
+            float u = float( i ) / grid, v = float( j ) / grid;
+            mesh.vertices.push_back( mesh_buffer_t::vertex_t{ { u, 0, v }, { 0, 1, 0 }, { u, v } } );
+        }
+    }
+    for ( int j = 0; j < grid; j++ ) {
+        for ( int i = 0; i < grid; i++ ) {
+            std::uint32_t a = j * side + i, b = a + 1, c = a + side + 1, d = a + side;
+            mesh.indices.insert( mesh.indices.end(), { a, d, c, a, c, b } );   // counter-clockwise seen from above
+        }
+    }
+
+    // Skirt: each edge of the grid joined to a copy of it skirt_depth lower.
+    auto edge = [&]( int i0, int j0, int di, int dj ) {
+        for ( int k = 0; k < grid; k++ ) {
+            std::uint32_t top0 = ( j0 + k * dj ) * side + i0 + k * di;
+            std::uint32_t top1 = ( j0 + ( k + 1 ) * dj ) * side + i0 + ( k + 1 ) * di;
+            std::uint32_t bottom0 = std::uint32_t( mesh.vertices.size() );
+            for ( std::uint32_t top : { top0, top1 } ) {
+                mesh_buffer_t::vertex_t vertex = mesh.vertices[top];
+                vertex.position[1] = -skirt_depth;
+                mesh.vertices.push_back( vertex );
+            }
+            mesh.indices.insert( mesh.indices.end(), { top0, bottom0, bottom0 + 1, top0, bottom0 + 1, top1 } );
+        }
+    };
+    edge( 0, 0, 1, 0 );
+    edge( grid, 0, 0, 1 );
+    edge( grid, grid, -1, 0 );
+    edge( 0, grid, 0, -1 );
+
+    mesh.ranges.push_back( mesh_buffer_t::range_t{ -1, 0, mesh.indices.size() } );
+}
+
+int ground_tiles_t::select( const double3 &eye, const std::vector<plane_t> &planes, std::vector<tile_t> &tiles ) const {
+    tiles.clear();
+    return select( tile_t{ -half_extent, -half_extent, 2 * half_extent, 0 }, eye, planes, tiles );
+}
+
+int ground_tiles_t::select( const tile_t &tile, const double3 &eye, const std::vector<plane_t> &planes, std::vector<tile_t> &tiles ) const {
+    if ( !planes.empty() && !box_in_planes( planes, mat4_t(), double3{ tile.x, y, tile.z }, double3{ tile.x + tile.size, y, tile.z + tile.size } ) )
+        return 1;
+
+    // Distance from eye to the nearest point of the tile.
+    double dx = std::max( { tile.x - eye[0], 0.0, eye[0] - tile.x - tile.size } );
+    double dz = std::max( { tile.z - eye[2], 0.0, eye[2] - tile.z - tile.size } );
+    double distance = std::sqrt( dx * dx + ( eye[1] - y ) * ( eye[1] - y ) + dz * dz );
+    if ( tile.size < 2 * min_tile || distance >= lod_distance * tile.size ) {
+        tiles.push_back( tile );
+        return 0;
+    }
+
+    double half = tile.size / 2;
+    int culled = 0;
+    for ( int k = 0; k < 4; k++ )
+        culled += select( tile_t{ tile.x + ( k & 1 ) * half, tile.z + ( k >> 1 ) * half, half, tile.level + 1 }, eye, planes, tiles );
+    return culled;
+}
+
+mat4_t ground_tiles_t::tile_matrix( const tile_t &tile ) const {
+    return mat4_t::translation( tile.x, y, tile.z ) * mat4_t::scaling( tile.size, tile.size, tile.size );
+}
@@ -0,0 +1,51 @@
+#ifndef _GROUND_TILES_H_
+#define _GROUND_TILES_H_
+
+#include <vector>
+#include "mat4.h"
+#include "mesh_bvh.h"
+#include "mesh_buffer.h"
+
+// A flat ground plane drawn as a quadtree of square tiles. Tiles near the
+// viewer are split down to min_tile, ones further away stay coarse, and any
+// subtree outside the view frustum is skipped whole, so the tiles drawn per
+// frame grow with the log of the ground's size, not with its area. Every
+// tile draws the same unit grid, scaled and moved into place by its matrix,
+// so nothing has to be built or uploaded as the viewer moves.
+class ground_tiles_t {
+public:
+	using double3 = mat4_t::double3;
+	using plane_t = mesh_bvh_t::plane_t;
+
+	struct tile_t {
+		double x, z;            // corner with the smallest coordinates
+		double size;
+		int level;              // 0 for the root covering the whole ground
+	};
+
+	// The square |x|, |z| <= half_extent at height y. A tile is split while
+	// the viewer is closer to it than lod_distance times its size, and each
+	// tile is a grid x grid mesh with a skirt hanging below its edges to hide
+	// cracks where tiles of different sizes meet.
+	ground_tiles_t( double half_extent, double y, double min_tile, double lod_distance = 2, int grid = 4 );
+
+	// Replace tiles with those to draw for a viewer at eye, skipping those
+	// outside planes (pass none to keep all). Returns how many were culled.
+	int select( const double3 &eye, const std::vector<plane_t> &planes, std::vector<tile_t> &tiles ) const;
+
+	// Places the unit grid (0..1 in x and z, at y = 0) on tile.
+	mat4_t tile_matrix( const tile_t &tile ) const;
+
+	// The unit grid shared by every tile; its skirt is 0.05 deep.
+	const mesh_buffer_t &grid() const {
+		return mesh;
+	}
+
+private:
+	double half_extent, y, min_tile, lod_distance;
+	mesh_buffer_t mesh;
+
+	int select( const tile_t &tile, const double3 &eye, const std::vector<plane_t> &planes, std::vector<tile_t> &tiles ) const;
+};
+
+#endif // _GROUND_TILES_H_
@@ -0,0 +1,122 @@
+#include <cstdio>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include "input_log.h"
+
+namespace {
+
+const char *kind_names[input_event_t::kinds] = { "reshape", "key", "button", "motion" };
+
+// Value at fraction q of sorted, by the nearest rank.
+double percentile( const std::vector<double> &sorted, double q ) {
+    std::size_t rank = std::size_t( q * ( sorted.size() - 1 ) + 0.5 );
+    return sorted[std::min( rank, sorted.size() - 1 )];
+}
+
+} // namespace
+
+void input_log_t::load( const char *path ) {
+    std::ifstream file( path );
+    if ( !file )
+        throw std::runtime_error( "Cannot open file." );
+
+    events.clear();
+    std::string line;
+    for ( int number = 1; std::getline( file, line ); number++ ) {
+        std::istringstream in( line );
+        std::string kind;
+        input_event_t event{};
+        if ( line.empty() || line[0] == '#' || !( in >> event.time ) )
+            continue;
+
+        bool ok = bool( in >> kind );
+        if ( ok && kind == "reshape" ) {
+            event.kind = input_event_t::reshape;
+            ok = bool( in >> event.x >> event.y );
+        } else if ( ok && kind == "key" ) {
+            event.kind = input_event_t::key;
+            ok = bool( in >> event.code >> event.x >> event.y >> event.modifiers );
+        } else if ( ok && kind == "button" ) {
+            event.kind = input_event_t::button;
+            ok = bool( in >> event.code >> event.state >> event.x >> event.y >> event.modifiers );
+        } else if ( ok && kind == "motion" ) {
+            event.kind = input_event_t::motion;
+            ok = bool( in >> event.x >> event.y );
+        } else
+            ok = false;
+
+        if ( !ok || ( !events.empty() && event.time < events.back().time ) )
+            throw std::runtime_error( "Bad input event on line " + std::to_string( number ) + "." );
+        events.push_back( event );
+    }
+}
+
+void input_log_t::save( const char *path ) const {
+    std::ofstream file( path );
+    for ( const input_event_t &event : events )
+        write( file, event );
+    if ( !file )
+        throw std::runtime_error( "Cannot write file." );
+}
+
+void input_log_t::write( std::ostream &out, const input_event_t &event ) {
+    char line[96];
+    switch ( event.kind ) {
+    case input_event_t::reshape:
+        snprintf( line, sizeof( line ), "%.6f reshape %d %d\n", event.time, event.x, event.y );
+        break;
+    case input_event_t::key:
+        snprintf( line, sizeof( line ), "%.6f key %d %d %d %d\n", event.time, event.code, event.x, event.y, event.modifiers );
+        break;
+    case input_event_t::button:
+        snprintf( line, sizeof( line ), "%.6f button %d %d %d %d %d\n", event.time, event.code, event.state, event.x, event.y, event.modifiers );
+        break;
+    case input_event_t::motion:
+        snprintf( line, sizeof( line ), "%.6f motion %d %d\n", event.time, event.x, event.y );
+        break;
+    }
+    out << line;
+}
+
+input_recorder_t::input_recorder_t( const char *path ) : out( path ), start( clock_type::now() ) {
+    if ( !out )
+        throw std::runtime_error( "Cannot write file." );
+    out << "# time kind ...: reshape w h | key code x y modifiers | button button state x y modifiers | motion x y\n";
+}
+
+void input_recorder_t::record( input_event_t::kind_t kind, int code, int state, int x, int y, int modifiers ) {
+    double time = std::chrono::duration<double>( clock_type::now() - start ).count();
+    input_log_t::write( out, input_event_t{ time, kind, code, state, x, y, modifiers } );
+    out.flush();
+}
+
+void input_latency_t::dispatched( const input_event_t &event, clock_type::time_point when ) {
+    waiting.emplace_back( event.kind, when );
+}
+
+void input_latency_t::presented( clock_type::time_point when ) {
+    for ( const auto &event : waiting )
+        latencies[event.first].push_back( std::chrono::duration<double, std::milli>( when - event.second ).count() );
+    waiting.clear();
+}
+
+void input_latency_t::print( std::ostream &out ) const {
+    char line[128];
+    for ( int kind = 0; kind < input_event_t::kinds; kind++ ) {
+        if ( latencies[kind].empty() )
+            continue;
+        std::vector<double> sorted = latencies[kind];
+        std::sort( sorted.begin(), sorted.end() );
+        double total = 0;
+        for ( double ms : sorted )
+            total += ms;
+        snprintf( line, sizeof( line ), "%-8s %6d events, latency mean %.2f ms, median %.2f ms, 95%% %.2f ms, max %.2f ms\n",
+                  kind_names[kind], ( int )sorted.size(), total / sorted.size(),
+                  percentile( sorted, 0.5 ), percentile( sorted, 0.95 ), sorted.back() );
+        out << line;
+    }
+    if ( !waiting.empty() )
+        out << waiting.size() << " events were never followed by a frame.\n";
+}
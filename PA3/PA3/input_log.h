@@ -0,0 +1,75 @@
+#ifndef _INPUT_LOG_H_
+#define _INPUT_LOG_H_
+
+#include <array>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <ostream>
+#include <utility>
+
+// One GLUT input event, as its callback received it. Coordinates are window
+// coordinates with y down; a reshape carries the new size in x and y.
+struct input_event_t {
+	enum kind_t { reshape, key, button, motion };
+	static const int kinds = 4;
+
+	double time;            // seconds since recording started
+	kind_t kind;
+	int code;               // key or mouse button
+	int state;              // GLUT_DOWN or GLUT_UP for a button
+	int x, y;
+	int modifiers;          // glutGetModifiers() for keys and buttons, otherwise 0
+};
+
+// A recorded stream of input events, saved as text with one event per line:
+//   <time> reshape <width> <height>
+//   <time> key <code> <x> <y> <modifiers>
+//   <time> button <button> <state> <x> <y> <modifiers>
+//   <time> motion <x> <y>
+// Lines starting with '#' are comments. Events are kept in time order.
+class input_log_t {
+public:
+	std::vector<input_event_t> events;
+
+	void load( const char *path );          // throws std::runtime_error naming the bad line
+	void save( const char *path ) const;
+
+	static void write( std::ostream &out, const input_event_t &event );
+};
+
+// Appends events to a log file as they happen, so the recording survives
+// however the program exits. Times count from construction.
+class input_recorder_t {
+public:
+	using clock_type = std::chrono::steady_clock;
+
+	explicit input_recorder_t( const char *path );  // throws std::runtime_error
+
+	void record( input_event_t::kind_t kind, int code, int state, int x, int y, int modifiers );
+
+private:
+	std::ofstream out;
+	clock_type::time_point start;
+};
+
+// Latency from the moment an input event reaches its handler to the end of
+// the first frame drawn after it, collected per kind of event.
+class input_latency_t {
+public:
+	using clock_type = std::chrono::steady_clock;
+
+	void dispatched( const input_event_t &event, clock_type::time_point when = clock_type::now() );
+
+	// A frame is done: every event dispatched since the last one is now shown.
+	void presented( clock_type::time_point when = clock_type::now() );
+
+	// Count, mean, median, 95th percentile and maximum per kind, in milliseconds.
+	void print( std::ostream &out ) const;
+
+private:
+	std::vector<std::pair<input_event_t::kind_t, clock_type::time_point>> waiting;
+	std::array<std::vector<double>, input_event_t::kinds> latencies;
+};
+
+#endif // _INPUT_LOG_H_
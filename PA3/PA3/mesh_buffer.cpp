@@ -0,0 +1,99 @@
+#include <cstring>
+#include <unordered_map>
+#include "mesh_buffer.h"
+
+namespace {
+
+using vertex_t = mesh_buffer_t::vertex_t;
+
+// Vertices are welded when all their attributes are bitwise equal.
+struct vertex_hash_t {
+    std::size_t operator()( const vertex_t &v ) const {
+        std::uint32_t bits[8];
+        std::memcpy( bits, &v, sizeof( bits ) );
+        std::uint64_t h = 14695981039346656037ull;          // FNV-1a over the attribute bits
+        for ( std::uint32_t b : bits ) {
+            h ^= b;
+            h *= 1099511628211ull;
+        }
+        return std::size_t( h );
+    }
+};
+
+struct vertex_equal_t {
+    bool operator()( const vertex_t &a, const vertex_t &b ) const {
+        return std::memcmp( &a, &b, sizeof( vertex_t ) ) == 0;
+    }
+};
+
+static_assert( sizeof( vertex_t ) == 8 * sizeof( float ), "vertex_t must have no padding to be hashed bytewise" );
+
+}
+
+mesh_buffer_t::mesh_buffer_t( const wavefront_obj_t &mesh ) : materials( mesh.materials ) {
+    std::unordered_map<vertex_t, std::uint32_t, vertex_hash_t, vertex_equal_t> welded;
+    welded.reserve( mesh.vertex_indices.size() );
+
+    auto corner = [&]( const wavefront_obj_t::face_t &face, std::size_t c ) {
+        std::size_t vi = face.idx_begin + c;
+        vertex_t v = {};
+        const wavefront_obj_t::double3 &p = mesh.vertices[mesh.vertex_indices[vi]];
+        const wavefront_obj_t::double3 *n = &face.normal;
+        int i;
+        if ( !mesh.is_flat && ( i = mesh.normal_indices[vi] ) >= 0 )
+            n = &mesh.normals[i];
+        for ( int k = 0; k < 3; ++k ) {
+            v.position[k] = float( p[k] );
+            v.normal[k] = float( ( *n )[k] );
+        }
+        if ( ( i = mesh.texcoord_indices[vi] ) >= 0 ) {
+            v.texcoord[0] = float( mesh.texcoords[i][0] );
+            v.texcoord[1] = float( mesh.texcoords[i][1] );
+        }
+
+        auto found = welded.emplace( v, std::uint32_t( vertices.size() ) );
+        if ( found.second )
+            vertices.push_back( v );
+        return found.first->second;
+    };
+
+    auto add_faces = [&]( int material, std::size_t begin, std::size_t count ) {
+        range_t range{ material, indices.size(), 0 };
+        for ( std::size_t f = begin; f < begin + count; ++f ) {
+            const wavefront_obj_t::face_t &face = mesh.faces[f];
+            bool complete = true;
+            for ( std::size_t c = 0; c < face.count; ++c ) {
+                int v = mesh.vertex_indices[face.idx_begin + c];
+                complete = complete && v >= 0 && std::size_t( v ) < mesh.vertices.size();
+            }
+            if ( !complete )
+                continue;
+            for ( std::size_t t = 1; t + 1 < face.count; ++t ) {     // polygons as fans, as draw() does
+                indices.push_back( corner( face, 0 ) );
+                indices.push_back( corner( face, t ) );
+                indices.push_back( corner( face, t + 1 ) );
+            }
+        }
+        range.index_count = indices.size() - range.index_begin;
+        if ( range.index_count > 0 )
+            ranges.push_back( range );
+    };
+
+    if ( mesh.batches.empty() ) {
+        add_faces( -1, 0, mesh.faces.size() );
+    } else {
+        for ( auto &batch : mesh.batches )
+            add_faces( batch.material, batch.face_begin, batch.face_count );
+    }
+    vertices.shrink_to_fit();
+}
+
+std::size_t mesh_buffer_t::memory_size() const {
+    std::size_t bytes = sizeof( *this )
+        + vertices.capacity() * sizeof( vertex_t )
+        + indices.capacity() * sizeof( std::uint32_t )
+        + ranges.capacity() * sizeof( range_t );
+    for ( auto &m : materials )
+        bytes += sizeof( m ) + m.name.capacity() + m.diffuse_map.capacity();
+    return bytes;
+}
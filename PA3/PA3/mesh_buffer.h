@@ -0,0 +1,41 @@
+#ifndef _MESH_BUFFER_H_
+#define _MESH_BUFFER_H_
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "wavefront_obj.h"
+
+// Welded, triangulated copy of a wavefront_obj_t for retained-mode drawing:
+// one interleaved vertex per distinct (position, normal, texcoord) corner and
+// 32-bit triangle indices, with one index range per material batch. Nothing
+// here calls GL, so the same arrays feed gl_mesh_t or a software rasterizer.
+struct mesh_buffer_t {
+	struct vertex_t {
+		float position[3];
+		float normal[3];        // the face normal where the mesh has none
+		float texcoord[2];      // 0, 0 where the mesh has none
+	};
+	struct range_t {
+		int material;           // index into materials, or -1 to keep the current material
+		std::size_t index_begin;
+		std::size_t index_count;
+	};
+
+	std::vector<vertex_t> vertices;
+	std::vector<std::uint32_t> indices;     // three per triangle
+	std::vector<range_t> ranges;            // cover indices in order
+	std::vector<wavefront_obj_t::material_t> materials;
+
+	mesh_buffer_t() {}
+	explicit mesh_buffer_t( const wavefront_obj_t &mesh );
+
+	std::size_t triangle_count() const {
+		return indices.size() / 3;
+	}
+
+	// Approximate heap footprint in bytes.
+	std::size_t memory_size() const;
+};
+
+#endif // _MESH_BUFFER_H_
@@ -0,0 +1,367 @@
+#include <cmath>
+#include <thread>
+#include <algorithm>
+#include "mesh_bvh.h"
+#include "parallel.h"
+
+namespace {
+
+using double3 = mesh_bvh_t::double3;
+using node_t = mesh_bvh_t::node_t;
+
+const int bin_count = 16;
+const int parallel_faces = 4096;    // subtrees smaller than this are built on the calling thread
+const int max_sah_depth = 40;       // deeper nodes split at the median, which bounds the depth
+
+double3 sub( const double3 &a, const double3 &b ) {
+    return double3{ a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+}
+
+double3 cross( const double3 &a, const double3 &b ) {
+    return double3{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+}
+
+double dot( const double3 &a, const double3 &b ) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+struct box_t {
+    double3 lo, hi;
+
+    box_t() {
+        const double inf = std::numeric_limits<double>::infinity();
+        lo = double3{ inf, inf, inf };
+        hi = double3{ -inf, -inf, -inf };
+    }
+
+    void grow( const double3 &p ) {
+        for ( int i = 0; i < 3; ++i ) {
+            lo[i] = std::min( lo[i], p[i] );
+            hi[i] = std::max( hi[i], p[i] );
+        }
+    }
+
+    void grow( const box_t &b ) {
+        for ( int i = 0; i < 3; ++i ) {
+            lo[i] = std::min( lo[i], b.lo[i] );
+            hi[i] = std::max( hi[i], b.hi[i] );
+        }
+    }
+
+    double half_area() const {
+        if ( lo[0] > hi[0] )
+            return 0;
+        double3 d = sub( hi, lo );
+        return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+    }
+};
+
+// Slab test; returns the entry distance or infinity on a miss.
+double ray_box( const double3 &lo, const double3 &hi, const double3 &origin, const double3 &inv_dir, double t_max ) {
+    double t0 = 0, t1 = t_max;
+    for ( int i = 0; i < 3; ++i ) {
+        double a = ( lo[i] - origin[i] ) * inv_dir[i];
+        double b = ( hi[i] - origin[i] ) * inv_dir[i];
+        if ( a > b )
+            std::swap( a, b );
+        t0 = std::max( t0, a );
+        t1 = std::min( t1, b );
+        if ( t0 > t1 )
+            return std::numeric_limits<double>::infinity();
+    }
+    return t0;
+}
+
+enum class side_t { outside, intersecting, inside };
+
+side_t classify( const double3 &lo, const double3 &hi, const std::vector<mesh_bvh_t::plane_t> &planes ) {
+    side_t result = side_t::inside;
+    for ( auto &p : planes ) {
+        // corners of the box furthest along and against the plane normal
+        double3 far_in, far_out;
+        for ( int i = 0; i < 3; ++i ) {
+            far_in[i] = p[i] >= 0 ? hi[i] : lo[i];
+            far_out[i] = p[i] >= 0 ? lo[i] : hi[i];
+        }
+        if ( p[0] * far_in[0] + p[1] * far_in[1] + p[2] * far_in[2] + p[3] < 0 )
+            return side_t::outside;
+        if ( p[0] * far_out[0] + p[1] * far_out[1] + p[2] * far_out[2] + p[3] < 0 )
+            result = side_t::intersecting;
+    }
+    return result;
+}
+
+}
+
+mesh_bvh_t::mesh_bvh_t( const wavefront_obj_t &mesh, int max_leaf_faces )
+    : mesh( mesh ), max_leaf( std::max( 1, max_leaf_faces ) ) {
+    const int count = int( mesh.faces.size() );
+    face_lo.resize( count );
+    face_hi.resize( count );
+    face_centroid.resize( count );
+    face_order.resize( count );
+
+    parallel_for( 0, count, [&]( std::size_t f ) {
+        const wavefront_obj_t::face_t &face = mesh.faces[f];
+        box_t box;
+        for ( std::size_t i = 0; i < face.count; ++i ) {
+            int v = mesh.vertex_indices[face.idx_begin + i];
+            if ( v >= 0 && std::size_t( v ) < mesh.vertices.size() )
+                box.grow( mesh.vertices[v] );
+        }
+        if ( box.lo[0] > box.hi[0] )
+            box.lo = box.hi = double3{ 0, 0, 0 };
+        face_lo[f] = box.lo;
+        face_hi[f] = box.hi;
+        for ( int i = 0; i < 3; ++i )
+            face_centroid[f][i] = 0.5 * ( box.lo[i] + box.hi[i] );
+        face_order[f] = int( f );
+    } );
+
+    nodes.reserve( 2 * count / max_leaf + 1 );
+    build( 0, count, nodes, 0 );
+}
+
+//------------------------------------------------------------------------------
+// Append the subtree over face_order[begin, end) to out. Child indices are
+// relative to the start of out, so a subtree built into its own vector by
+// another thread can be spliced in by offsetting them.
+void mesh_bvh_t::build( int begin, int end, std::vector<node_t> &out, int depth ) {
+    const int self = int( out.size() );
+    const int count = end - begin;
+
+    box_t bounds, centroids;
+    for ( int i = begin; i < end; ++i ) {
+        int f = face_order[i];
+        bounds.grow( face_lo[f] );
+        bounds.grow( face_hi[f] );
+        centroids.grow( face_centroid[f] );
+    }
+    if ( count == 0 )
+        bounds.lo = bounds.hi = double3{ 0, 0, 0 };
+
+    node_t node;
+    node.lo = bounds.lo;
+    node.hi = bounds.hi;
+    node.child = -1;
+    node.face_begin = begin;
+    node.face_count = count;
+    node.pad = 0;
+    out.push_back( node );
+
+    if ( count <= max_leaf )
+        return;
+
+    // binned SAH over the widest centroid axis
+    int axis = 0;
+    double3 extent = sub( centroids.hi, centroids.lo );
+    if ( extent[1] > extent[axis] ) axis = 1;
+    if ( extent[2] > extent[axis] ) axis = 2;
+
+    int mid = begin + count / 2;
+    if ( depth >= max_sah_depth ) {
+        // degenerate input: fall back to object median splits to bound the depth
+        std::nth_element( &face_order[begin], &face_order[mid], &face_order[0] + end, [&]( int a, int b ) {
+            return face_centroid[a][axis] < face_centroid[b][axis];
+        } );
+    } else if ( extent[axis] > 0 ) {
+        box_t bin_bounds[bin_count];
+        int bin_faces[bin_count] = {};
+        const double scale = bin_count / extent[axis];
+        auto bin_of = [&]( int f ) {
+            int b = int( ( face_centroid[f][axis] - centroids.lo[axis] ) * scale );
+            return std::min( b, bin_count - 1 );
+        };
+
+        for ( int i = begin; i < end; ++i ) {
+            int f = face_order[i];
+            int b = bin_of( f );
+            ++bin_faces[b];
+            bin_bounds[b].grow( face_lo[f] );
+            bin_bounds[b].grow( face_hi[f] );
+        }
+
+        // sweep from the right to get the cost of every right-hand side
+        double right_area[bin_count];
+        int right_faces[bin_count];
+        box_t acc;
+        int n = 0;
+        for ( int b = bin_count - 1; b > 0; --b ) {
+            acc.grow( bin_bounds[b] );
+            n += bin_faces[b];
+            right_area[b] = acc.half_area();
+            right_faces[b] = n;
+        }
+
+        double best_cost = std::numeric_limits<double>::infinity();
+        int best_split = -1;
+        acc = box_t();
+        n = 0;
+        for ( int b = 0; b + 1 < bin_count; ++b ) {
+            acc.grow( bin_bounds[b] );
+            n += bin_faces[b];
+            if ( n == 0 || right_faces[b + 1] == 0 )
+                continue;
+            double cost = acc.half_area() * n + right_area[b + 1] * right_faces[b + 1];
+            if ( cost < best_cost ) {
+                best_cost = cost;
+                best_split = b;
+            }
+        }
+
+        // a leaf is cheaper than any split: keep it unless it is far too big
+        double leaf_cost = bounds.half_area() * count;
+        if ( best_split < 0 || ( best_cost >= leaf_cost && count <= 4 * max_leaf ) )
+            return;
+
+        int *split = std::partition( &face_order[begin], &face_order[0] + end, [&]( int f ) {
+            return bin_of( f ) <= best_split;
+        } );
+        mid = int( split - &face_order[0] );
+    }
+
+    if ( count >= parallel_faces && ( 1u << depth ) < std::thread::hardware_concurrency() ) {
+        std::vector<node_t> left, right;
+        std::thread worker( [&]() {
+            build( begin, mid, left, depth + 1 );
+        } );
+        build( mid, end, right, depth + 1 );
+        worker.join();
+
+        for ( auto *subtree : { &left, &right } ) {
+            const int base = int( out.size() );
+            if ( subtree == &right )
+                out[self].child = base;
+            for ( node_t n : *subtree ) {
+                if ( n.child >= 0 )
+                    n.child += base;
+                out.push_back( n );
+            }
+        }
+    } else {
+        build( begin, mid, out, depth + 1 );
+        out[self].child = int( out.size() );
+        build( mid, end, out, depth + 1 );
+    }
+}
+
+//------------------------------------------------------------------------------
+bool mesh_bvh_t::intersect_face( int f, const double3 &origin, const double3 &dir, double t_max, double &t ) const {
+    const wavefront_obj_t::face_t &face = mesh.faces[f];
+    const int *idx = &mesh.vertex_indices[face.idx_begin];
+    const int vertex_count = int( mesh.vertices.size() );
+    bool found = false;
+
+    // Moller-Trumbore on the fan triangulation of the polygon, skipping
+    // triangles with a corner that names no vertex, as the bounds pass does
+    for ( std::size_t i = 1; i + 1 < face.count; ++i ) {
+        if ( idx[0] < 0 || idx[i] < 0 || idx[i + 1] < 0
+             || idx[0] >= vertex_count || idx[i] >= vertex_count || idx[i + 1] >= vertex_count )
+            continue;
+        const double3 &v0 = mesh.vertices[idx[0]];
+        double3 e1 = sub( mesh.vertices[idx[i]], v0 );
+        double3 e2 = sub( mesh.vertices[idx[i + 1]], v0 );
+        double3 p = cross( dir, e2 );
+        double det = dot( e1, p );
+        if ( det == 0 )
+            continue;
+        double inv = 1 / det;
+        double3 s = sub( origin, v0 );
+        double u = dot( s, p ) * inv;
+        if ( u < 0 || u > 1 )
+            continue;
+        double3 q = cross( s, e1 );
+        double v = dot( dir, q ) * inv;
+        if ( v < 0 || u + v > 1 )
+            continue;
+        double d = dot( e2, q ) * inv;
+        if ( d >= 0 && d < t_max ) {
+            t_max = d;
+            t = d;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool mesh_bvh_t::intersect_ray( const double3 &origin, const double3 &dir, hit_t &hit, double t_max ) const {
+    const double inf = std::numeric_limits<double>::infinity();
+    double3 inv_dir;
+    for ( int i = 0; i < 3; ++i )
+        inv_dir[i] = dir[i] != 0 ? 1 / dir[i] : inf;
+
+    bool found = false;
+    std::vector<int> stack{ 0 };
+    stack.reserve( 64 );
+
+    while ( !stack.empty() ) {
+        const node_t &node = nodes[stack.back()];
+        stack.pop_back();
+        if ( ray_box( node.lo, node.hi, origin, inv_dir, t_max ) == inf )
+            continue;
+
+        if ( node.child < 0 ) {
+            for ( int i = node.face_begin; i < node.face_begin + node.face_count; ++i ) {
+                double t;
+                if ( intersect_face( face_order[i], origin, dir, t_max, t ) ) {
+                    t_max = t;
+                    hit.face = face_order[i];
+                    hit.t = t;
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        // visit the nearer child first so t_max shrinks early
+        int left = int( &node - &nodes[0] ) + 1, right = node.child;
+        double tl = ray_box( nodes[left].lo, nodes[left].hi, origin, inv_dir, t_max );
+        double tr = ray_box( nodes[right].lo, nodes[right].hi, origin, inv_dir, t_max );
+        if ( tl > tr ) {
+            std::swap( left, right );
+            std::swap( tl, tr );
+        }
+        if ( tr != inf )
+            stack.push_back( right );
+        if ( tl != inf )
+            stack.push_back( left );
+    }
+
+    if ( found ) {
+        for ( int i = 0; i < 3; ++i )
+            hit.point[i] = origin[i] + hit.t * dir[i];
+    }
+    return found;
+}
+
+void mesh_bvh_t::query_frustum( const std::vector<plane_t> &planes, std::vector<int> &faces ) const {
+    std::vector<int> stack{ 0 };
+    stack.reserve( 64 );
+
+    while ( !stack.empty() ) {
+        int index = stack.back();
+        stack.pop_back();
+        const node_t &node = nodes[index];
+
+        side_t side = classify( node.lo, node.hi, planes );
+        if ( side == side_t::outside )
+            continue;
+        if ( side == side_t::inside ) {
+            faces.insert( faces.end(), face_order.begin() + node.face_begin,
+                          face_order.begin() + node.face_begin + node.face_count );
+            continue;
+        }
+
+        if ( node.child < 0 ) {
+            for ( int i = node.face_begin; i < node.face_begin + node.face_count; ++i ) {
+                int f = face_order[i];
+                if ( classify( face_lo[f], face_hi[f], planes ) != side_t::outside )
+                    faces.push_back( f );
+            }
+            continue;
+        }
+
+        stack.push_back( node.child );
+        stack.push_back( index + 1 );
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef _MESH_BVH_H_
+#define _MESH_BVH_H_
+
+#include <vector>
+#include <array>
+#include <limits>
+#include "wavefront_obj.h"
+
+// Bounding volume hierarchy over the faces of a wavefront_obj_t, built with
+// the binned surface area heuristic. Nodes are stored depth-first in one
+// array: the left child of a node directly follows it, so a traversal walks
+// memory mostly forward. The mesh must outlive the hierarchy.
+class mesh_bvh_t {
+public:
+	using double3 = wavefront_obj_t::double3;
+	using plane_t = std::array<double, 4>; // a, b, c, d: inside when a*x + b*y + c*z + d >= 0
+
+	struct node_t {
+		double3 lo, hi;     // bounds of every face below this node
+		int child;          // index of the right child, or -1 for a leaf
+		int face_begin;     // faces below this node are face_order[face_begin .. face_begin + face_count)
+		int face_count;
+		int pad;
+	};
+	struct hit_t {
+		int face;           // index into mesh.faces
+		double t;           // distance along the ray in units of its direction
+		double3 point;
+	};
+
+	const wavefront_obj_t &mesh;
+	std::vector<node_t> nodes;
+	std::vector<int> face_order;
+
+	mesh_bvh_t( const wavefront_obj_t &mesh, int max_leaf_faces = 4 );
+
+	// Nearest face hit by origin + t * dir with 0 <= t < t_max.
+	bool intersect_ray( const double3 &origin, const double3 &dir, hit_t &hit,
+	                    double t_max = std::numeric_limits<double>::infinity() ) const;
+
+	// Append every face whose bounds are not entirely outside one of planes.
+	void query_frustum( const std::vector<plane_t> &planes, std::vector<int> &faces ) const;
+
+	// Bounds of the whole mesh.
+	const node_t &root() const { return nodes[0]; }
+
+private:
+	std::vector<double3> face_lo, face_hi, face_centroid;
+	int max_leaf;
+
+	void build( int begin, int end, std::vector<node_t> &out, int depth );
+	bool intersect_face( int f, const double3 &origin, const double3 &dir, double t_max, double &t ) const;
+};
+
+#endif // _MESH_BVH_H_
@@ -0,0 +1,213 @@
+#include <cmath>
+#include <algorithm>
+#include <GL/glut.h>
+#include "mesh_cluster.h"
+
+namespace {
+
+using double3 = mesh_cluster_t::double3;
+using triangle_t = std::array<std::size_t, 3>;
+
+double3 sub( const double3 &a, const double3 &b ) {
+    return double3{ a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+}
+
+double dot( const double3 &a, const double3 &b ) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+double3 normalize( double3 u ) {
+    double l = std::sqrt( dot( u, u ) );
+    if ( l == 0 )
+        return u;
+    return double3{ u[0] / l, u[1] / l, u[2] / l };
+}
+
+double3 triangle_normal( const double3 &v0, const double3 &v1, const double3 &v2 ) {
+    double3 a = sub( v1, v0 ), b = sub( v2, v0 );
+    return normalize( double3{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] } );
+}
+
+}
+
+//------------------------------------------------------------------------------
+// Greedy partition: a cluster grows from a seed triangle by repeatedly taking
+// the neighbouring triangle that adds the fewest new vertices, until either
+// limit is reached or it runs out of neighbours.
+mesh_cluster_t::mesh_cluster_t( const wavefront_obj_t &mesh, std::size_t max_vertices, std::size_t max_triangles )
+    : mesh( mesh ) {
+    max_vertices = std::max<std::size_t>( 3, std::min<std::size_t>( max_vertices, 256 ) );
+    max_triangles = std::max<std::size_t>( 1, max_triangles );
+
+    const std::size_t vertex_count = mesh.vertices.size();
+    std::vector<triangle_t> triangles;
+    std::vector<std::size_t> faces_of;
+    std::vector<double3> normals;
+    for ( std::size_t f = 0; f < mesh.faces.size(); ++f ) {
+        const wavefront_obj_t::face_t &face = mesh.faces[f];
+        bool valid = true;
+        for ( std::size_t i = 0; i < face.count; ++i ) {
+            int v = mesh.vertex_indices[face.idx_begin + i];
+            valid = valid && v >= 0 && std::size_t( v ) < vertex_count;
+        }
+        if ( !valid )
+            continue;
+        for ( std::size_t i = 1; i + 1 < face.count; ++i ) {
+            triangle_t tri{ face.idx_begin, face.idx_begin + i, face.idx_begin + i + 1 };
+            triangles.push_back( tri );
+            faces_of.push_back( f );
+            normals.push_back( triangle_normal( mesh.vertices[mesh.vertex_indices[tri[0]]],
+                                                mesh.vertices[mesh.vertex_indices[tri[1]]],
+                                                mesh.vertices[mesh.vertex_indices[tri[2]]] ) );
+        }
+    }
+
+    // vertex-to-triangle adjacency in compressed rows
+    std::vector<std::size_t> adjacency_begin( vertex_count + 1, 0 );
+    for ( auto &tri : triangles ) {
+        for ( std::size_t corner : tri )
+            ++adjacency_begin[mesh.vertex_indices[corner] + 1];
+    }
+    for ( std::size_t v = 0; v < vertex_count; ++v )
+        adjacency_begin[v + 1] += adjacency_begin[v];
+    std::vector<std::size_t> adjacency( adjacency_begin[vertex_count] );
+    std::vector<std::size_t> cursor( adjacency_begin.begin(), adjacency_begin.end() - 1 );
+    for ( std::size_t t = 0; t < triangles.size(); ++t ) {
+        for ( std::size_t corner : triangles[t] )
+            adjacency[cursor[mesh.vertex_indices[corner]]++] = t;
+    }
+
+    std::vector<char> used( triangles.size(), 0 ), queued( triangles.size(), 0 );
+    std::vector<int> local( vertex_count, -1 );     // vertex -> index within the current cluster
+    std::vector<std::size_t> candidates;
+    std::vector<double3> emitted_normals;           // normals in cluster order
+
+    for ( std::size_t seed = 0; seed < triangles.size(); ++seed ) {
+        if ( used[seed] )
+            continue;
+
+        cluster_t c;
+        c.vertex_begin = cluster_vertices.size();
+        c.vertex_count = 0;
+        c.triangle_begin = triangle_faces.size();
+        c.triangle_count = 0;
+
+        candidates.assign( 1, seed );
+        queued[seed] = 1;
+        while ( !candidates.empty() && c.triangle_count < max_triangles ) {
+            std::size_t best = candidates.size();
+            int best_new = 4;
+            for ( std::size_t k = 0; k < candidates.size(); ++k ) {
+                int added = 0;
+                for ( std::size_t corner : triangles[candidates[k]] )
+                    added += local[mesh.vertex_indices[corner]] < 0;
+                if ( c.vertex_count + added <= max_vertices && added < best_new ) {
+                    best = k;
+                    best_new = added;
+                }
+            }
+            if ( best == candidates.size() )
+                break;
+
+            std::size_t t = candidates[best];
+            candidates[best] = candidates.back();
+            candidates.pop_back();
+            used[t] = 1;
+
+            for ( std::size_t corner : triangles[t] ) {
+                int v = mesh.vertex_indices[corner];
+                if ( local[v] < 0 ) {
+                    local[v] = int( c.vertex_count++ );
+                    cluster_vertices.push_back( v );
+                }
+                cluster_triangles.push_back( std::uint8_t( local[v] ) );
+                cluster_corners.push_back( corner );
+            }
+            triangle_faces.push_back( faces_of[t] );
+            emitted_normals.push_back( normals[t] );
+            ++c.triangle_count;
+
+            for ( std::size_t corner : triangles[t] ) {
+                int v = mesh.vertex_indices[corner];
+                for ( std::size_t i = adjacency_begin[v]; i < adjacency_begin[v + 1]; ++i ) {
+                    std::size_t n = adjacency[i];
+                    if ( !used[n] && !queued[n] ) {
+                        queued[n] = 1;
+                        candidates.push_back( n );
+                    }
+                }
+            }
+        }
+
+        for ( std::size_t t : candidates )
+            queued[t] = 0;
+        for ( std::size_t i = c.vertex_begin; i < c.vertex_begin + c.vertex_count; ++i )
+            local[cluster_vertices[i]] = -1;
+
+        // bounding sphere around the center of the cluster's box
+        double3 lo = mesh.vertices[cluster_vertices[c.vertex_begin]], hi = lo;
+        for ( std::size_t i = c.vertex_begin; i < c.vertex_begin + c.vertex_count; ++i ) {
+            const double3 &p = mesh.vertices[cluster_vertices[i]];
+            for ( int a = 0; a < 3; ++a ) {
+                lo[a] = std::min( lo[a], p[a] );
+                hi[a] = std::max( hi[a], p[a] );
+            }
+        }
+        for ( int a = 0; a < 3; ++a )
+            c.center[a] = 0.5 * ( lo[a] + hi[a] );
+        c.radius = 0;
+        for ( std::size_t i = c.vertex_begin; i < c.vertex_begin + c.vertex_count; ++i ) {
+            double3 d = sub( mesh.vertices[cluster_vertices[i]], c.center );
+            c.radius = std::max( c.radius, std::sqrt( dot( d, d ) ) );
+        }
+
+        // normal cone: average direction and the widest deviation from it
+        double3 axis{ 0, 0, 0 };
+        for ( std::size_t i = c.triangle_begin; i < c.triangle_begin + c.triangle_count; ++i ) {
+            for ( int a = 0; a < 3; ++a )
+                axis[a] += emitted_normals[i][a];
+        }
+        c.cone_axis = normalize( axis );
+        double min_dot = 1;
+        for ( std::size_t i = c.triangle_begin; i < c.triangle_begin + c.triangle_count; ++i )
+            min_dot = std::min( min_dot, dot( emitted_normals[i], c.cone_axis ) );
+        c.cone_cutoff = min_dot <= 0.1 ? 1.0 : std::sqrt( 1 - min_dot * min_dot );
+
+        clusters.push_back( c );
+    }
+}
+
+bool mesh_cluster_t::is_backfacing( const cluster_t &c, const double3 &eye ) const {
+    if ( c.cone_cutoff >= 1 )
+        return false;
+    double3 d = sub( c.center, eye );
+    return dot( d, c.cone_axis ) >= c.cone_cutoff * std::sqrt( dot( d, d ) ) + c.radius;
+}
+
+bool mesh_cluster_t::is_outside( const cluster_t &c, const std::vector<plane_t> &planes ) const {
+    for ( auto &p : planes ) {
+        double l = std::sqrt( p[0] * p[0] + p[1] * p[1] + p[2] * p[2] );
+        if ( p[0] * c.center[0] + p[1] * c.center[1] + p[2] * c.center[2] + p[3] < -c.radius * l )
+            return true;
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+void mesh_cluster_t::draw( const cluster_t &c ) const {
+    glBegin( GL_TRIANGLES );
+    for ( std::size_t t = c.triangle_begin; t < c.triangle_begin + c.triangle_count; ++t ) {
+        if ( mesh.is_flat )
+            glNormal3dv( mesh.faces[triangle_faces[t]].normal.data() );
+        for ( std::size_t k = 0; k < 3; ++k ) {
+            std::size_t corner = cluster_corners[3 * t + k];
+            int i;
+            if ( !mesh.is_flat && ( i = mesh.normal_indices[corner] ) >= 0 )
+                glNormal3dv( mesh.normals[i].data() );
+            if ( ( i = mesh.texcoord_indices[corner] ) >= 0 )
+                glTexCoord2dv( mesh.texcoords[i].data() );
+            glVertex3dv( mesh.vertices[cluster_vertices[c.vertex_begin + cluster_triangles[3 * t + k]]].data() );
+        }
+    }
+    glEnd();
+}
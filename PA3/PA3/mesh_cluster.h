@@ -0,0 +1,52 @@
+#ifndef _MESH_CLUSTER_H_
+#define _MESH_CLUSTER_H_
+
+#include <vector>
+#include <array>
+#include <cstdint>
+#include "wavefront_obj.h"
+
+// Partition of a wavefront_obj_t into small clusters of adjacent triangles
+// (meshlets). Every cluster has a bounding sphere for frustum culling and a
+// normal cone for backface culling, and is a self-contained unit of work for
+// transforming or drawing. The mesh must outlive the partition.
+class mesh_cluster_t {
+public:
+	using double3 = wavefront_obj_t::double3;
+	using plane_t = std::array<double, 4>; // a, b, c, d: inside when a*x + b*y + c*z + d >= 0
+
+	static constexpr std::size_t default_max_vertices = 64;
+	static constexpr std::size_t default_max_triangles = 124;
+
+	struct cluster_t {
+		std::size_t vertex_begin, vertex_count;     // range of cluster_vertices
+		std::size_t triangle_begin, triangle_count; // range of triangles, three entries each in cluster_triangles/corners
+		double3 center;
+		double radius;
+		double3 cone_axis;      // average facing direction of the triangles
+		double cone_cutoff;     // sine of the cone's half angle, 1 when the cone cannot be culled
+	};
+
+	const wavefront_obj_t &mesh;
+	std::vector<cluster_t> clusters;
+	std::vector<int> cluster_vertices;              // mesh vertex indices used by each cluster
+	std::vector<std::uint8_t> cluster_triangles;    // per triangle corner: index into the cluster's vertices
+	std::vector<std::size_t> cluster_corners;       // per triangle corner: index into mesh.vertex_indices, for attributes
+	std::vector<std::size_t> triangle_faces;        // per triangle: index into mesh.faces
+
+	mesh_cluster_t( const wavefront_obj_t &mesh,
+	                std::size_t max_vertices = default_max_vertices,
+	                std::size_t max_triangles = default_max_triangles );
+
+	// True if every triangle of cluster c faces away from eye (model space).
+	bool is_backfacing( const cluster_t &c, const double3 &eye ) const;
+
+	// True if the bounding sphere of cluster c is entirely outside one of planes.
+	// Planes need not be normalized.
+	bool is_outside( const cluster_t &c, const std::vector<plane_t> &planes ) const;
+
+	// Draw cluster c with GL, with the attributes of the source mesh.
+	void draw( const cluster_t &c ) const;
+};
+
+#endif // _MESH_CLUSTER_H_
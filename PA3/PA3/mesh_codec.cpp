@@ -0,0 +1,402 @@
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "mesh_codec.h"
+
+namespace {
+
+using double2 = wavefront_obj_t::double2;
+using double3 = wavefront_obj_t::double3;
+
+const std::uint8_t magic[4] = { 'P', 'M', 'S', 'H' };
+const std::uint8_t version = 3;       // 3: corners stored in face order
+const std::int16_t zero_normal = -32768;    // octahedral x of a {0, 0, 0} normal
+const std::size_t min_material_bytes = 12 * 8 + 8 + 2;  // ambient, diffuse and specular as f64, shininess, and two empty string lengths
+
+class writer_t {
+public:
+    std::vector<std::uint8_t> bytes;
+
+    void u8( std::uint8_t v ) {
+        bytes.push_back( v );
+    }
+
+    void u16( std::uint16_t v ) {
+        bytes.push_back( std::uint8_t( v ) );
+        bytes.push_back( std::uint8_t( v >> 8 ) );
+    }
+
+    void u32( std::uint32_t v ) {
+        for ( int i = 0; i < 4; ++i )
+            bytes.push_back( std::uint8_t( v >> ( 8 * i ) ) );
+    }
+
+    void f64( double d ) {
+        std::uint64_t v;
+        std::memcpy( &v, &d, sizeof( v ) );
+        for ( int i = 0; i < 8; ++i )
+            bytes.push_back( std::uint8_t( v >> ( 8 * i ) ) );
+    }
+
+    void varint( std::uint32_t v ) {
+        while ( v >= 0x80 ) {
+            bytes.push_back( std::uint8_t( v | 0x80 ) );
+            v >>= 7;
+        }
+        bytes.push_back( std::uint8_t( v ) );
+    }
+
+    void str( const std::string &s ) {
+        varint( std::uint32_t( s.size() ) );
+        bytes.insert( bytes.end(), s.begin(), s.end() );
+    }
+};
+
+class reader_t {
+public:
+    reader_t( const std::uint8_t *data, std::size_t size ) : p( data ), end( data + size ) {}
+
+    void need( std::size_t n ) {
+        if ( std::size_t( end - p ) < n )
+            throw std::runtime_error( "Truncated mesh data." );
+    }
+
+    std::uint8_t u8() {
+        need( 1 );
+        return *p++;
+    }
+
+    std::uint16_t u16() {
+        need( 2 );
+        std::uint16_t v = std::uint16_t( p[0] | ( p[1] << 8 ) );
+        p += 2;
+        return v;
+    }
+
+    std::uint32_t u32() {
+        need( 4 );
+        std::uint32_t v = 0;
+        for ( int i = 0; i < 4; ++i )
+            v |= std::uint32_t( p[i] ) << ( 8 * i );
+        p += 4;
+        return v;
+    }
+
+    double f64() {
+        need( 8 );
+        std::uint64_t v = 0;
+        for ( int i = 0; i < 8; ++i )
+            v |= std::uint64_t( p[i] ) << ( 8 * i );
+        p += 8;
+        double d;
+        std::memcpy( &d, &v, sizeof( d ) );
+        return d;
+    }
+
+    std::uint32_t varint() {
+        std::uint32_t v = 0;
+        for ( int shift = 0; shift < 35; shift += 7 ) {
+            need( 1 );
+            std::uint8_t b = *p++;
+            v |= std::uint32_t( b & 0x7f ) << shift;
+            if ( !( b & 0x80 ) )
+                return v;
+        }
+        throw std::runtime_error( "Corrupt varint in mesh data." );
+    }
+
+    std::string str() {
+        std::size_t n = varint();
+        need( n );
+        std::string s( reinterpret_cast<const char *>( p ), n );
+        p += n;
+        return s;
+    }
+
+private:
+    const std::uint8_t *p, *end;
+};
+
+std::uint32_t zigzag( std::int32_t v ) {
+    return ( std::uint32_t( v ) << 1 ) ^ std::uint32_t( v >> 31 );
+}
+
+std::int32_t unzigzag( std::uint32_t v ) {
+    return std::int32_t( v >> 1 ) ^ -std::int32_t( v & 1 );
+}
+
+std::uint16_t quantize( double x, double lo, double hi ) {
+    if ( hi <= lo )
+        return 0;
+    double t = ( x - lo ) / ( hi - lo );
+    return std::uint16_t( std::lround( std::max( 0.0, std::min( 1.0, t ) ) * 65535 ) );
+}
+
+double dequantize( std::uint16_t q, double lo, double hi ) {
+    return lo + ( hi - lo ) * ( q / 65535.0 );
+}
+
+double sign( double x ) {
+    return x < 0 ? -1.0 : 1.0;
+}
+
+std::int16_t snorm16( double x ) {
+    return std::int16_t( std::lround( std::max( -1.0, std::min( 1.0, x ) ) * 32767 ) );
+}
+
+// Project the unit sphere onto an octahedron and unfold it into a square.
+void encode_octahedral( const double3 &n, std::int16_t &u, std::int16_t &v ) {
+    double l = std::fabs( n[0] ) + std::fabs( n[1] ) + std::fabs( n[2] );
+    if ( l == 0 ) {
+        u = v = zero_normal;
+        return;
+    }
+    double x = n[0] / l, y = n[1] / l;
+    if ( n[2] < 0 ) {
+        double fx = ( 1 - std::fabs( y ) ) * sign( x );
+        double fy = ( 1 - std::fabs( x ) ) * sign( y );
+        x = fx;
+        y = fy;
+    }
+    u = snorm16( x );
+    v = snorm16( y );
+}
+
+double3 decode_octahedral( std::int16_t u, std::int16_t v ) {
+    if ( u == zero_normal )
+        return double3{ 0, 0, 0 };
+    double x = u / 32767.0, y = v / 32767.0;
+    double z = 1 - std::fabs( x ) - std::fabs( y );
+    if ( z < 0 ) {
+        double fx = ( 1 - std::fabs( y ) ) * sign( x );
+        double fy = ( 1 - std::fabs( x ) ) * sign( y );
+        x = fx;
+        y = fy;
+    }
+    double l = std::sqrt( x * x + y * y + z * z );
+    return double3{ x / l, y / l, z / l };
+}
+
+void encode_material( writer_t &out, const wavefront_obj_t::material_t &m ) {
+    out.str( m.name );
+    for ( int i = 0; i < 4; ++i ) {
+        out.f64( m.ambient[i] );
+        out.f64( m.diffuse[i] );
+        out.f64( m.specular[i] );
+    }
+    out.f64( m.shininess );
+    out.str( m.diffuse_map );
+}
+
+wavefront_obj_t::material_t decode_material( reader_t &in ) {
+    wavefront_obj_t::material_t m;
+    m.name = in.str();
+    for ( int i = 0; i < 4; ++i ) {
+        m.ambient[i] = float( in.f64() );
+        m.diffuse[i] = float( in.f64() );
+        m.specular[i] = float( in.f64() );
+    }
+    m.shininess = float( in.f64() );
+    m.diffuse_map = in.str();
+    return m;
+}
+
+// The corners of every face in turn, which sort_faces_by_material() may have
+// left in another order than the index arrays.
+void encode_indices( writer_t &out, const wavefront_obj_t &mesh, const std::vector<int> &indices ) {
+    std::int32_t previous = 0;
+    for ( auto &face : mesh.faces ) {
+        for ( std::size_t c = face.idx_begin; c < face.idx_begin + face.count; ++c ) {
+            out.varint( zigzag( indices[c] - previous ) );
+            previous = indices[c];
+        }
+    }
+}
+
+// Every index must be -1 (none) or below limit.
+void decode_indices( reader_t &in, std::vector<int> &indices, std::size_t count, std::size_t limit, const char *what ) {
+    indices.resize( count );
+    std::int64_t previous = 0;
+    for ( std::size_t i = 0; i < count; ++i ) {
+        previous += unzigzag( in.varint() );
+        if ( previous < -1 || previous >= std::int64_t( limit ) )
+            throw std::runtime_error( std::string( "Corrupt packed mesh " ) + what + " index." );
+        indices[i] = int( previous );
+    }
+}
+
+}
+
+std::vector<std::uint8_t> encode_mesh( const wavefront_obj_t &mesh ) {
+    writer_t out;
+    out.bytes.reserve( 64 + mesh.vertices.size() * 6 + mesh.normals.size() * 4 +
+                       mesh.texcoords.size() * 4 + mesh.vertex_indices.size() * 4 );
+
+    for ( std::uint8_t m : magic )
+        out.u8( m );
+    out.u8( version );
+    out.u8( mesh.is_flat ? 1 : 0 );
+    out.u32( std::uint32_t( mesh.vertices.size() ) );
+    out.u32( std::uint32_t( mesh.normals.size() ) );
+    out.u32( std::uint32_t( mesh.texcoords.size() ) );
+    out.u32( std::uint32_t( mesh.faces.size() ) );
+    std::size_t corner_count = 0;
+    for ( auto &face : mesh.faces )
+        corner_count += face.count;
+    out.u32( std::uint32_t( corner_count ) );
+    out.u32( std::uint32_t( mesh.materials.size() ) );
+    for ( auto &m : mesh.materials )
+        encode_material( out, m );
+
+    // recompute the box rather than trusting aabb, so every vertex quantises inside it
+    double3 lo{ 0, 0, 0 }, hi{ 0, 0, 0 };
+    if ( !mesh.vertices.empty() )
+        lo = hi = mesh.vertices[0];
+    for ( auto &v : mesh.vertices ) {
+        for ( int i = 0; i < 3; ++i ) {
+            lo[i] = std::min( lo[i], v[i] );
+            hi[i] = std::max( hi[i], v[i] );
+        }
+    }
+    double2 tlo{ 0, 0 }, thi{ 0, 0 };
+    if ( !mesh.texcoords.empty() )
+        tlo = thi = mesh.texcoords[0];
+    for ( auto &t : mesh.texcoords ) {
+        for ( int i = 0; i < 2; ++i ) {
+            tlo[i] = std::min( tlo[i], t[i] );
+            thi[i] = std::max( thi[i], t[i] );
+        }
+    }
+    for ( int i = 0; i < 3; ++i ) {
+        out.f64( lo[i] );
+        out.f64( hi[i] );
+    }
+    for ( int i = 0; i < 2; ++i ) {
+        out.f64( tlo[i] );
+        out.f64( thi[i] );
+    }
+
+    for ( auto &v : mesh.vertices ) {
+        for ( int i = 0; i < 3; ++i )
+            out.u16( quantize( v[i], lo[i], hi[i] ) );
+    }
+    for ( auto &n : mesh.normals ) {
+        std::int16_t u, v;
+        encode_octahedral( n, u, v );
+        out.u16( std::uint16_t( u ) );
+        out.u16( std::uint16_t( v ) );
+    }
+    for ( auto &t : mesh.texcoords ) {
+        for ( int i = 0; i < 2; ++i )
+            out.u16( quantize( t[i], tlo[i], thi[i] ) );
+    }
+
+    for ( auto &face : mesh.faces ) {
+        out.varint( std::uint32_t( face.count ) );
+        out.varint( std::uint32_t( face.material + 1 ) );
+    }
+    encode_indices( out, mesh, mesh.vertex_indices );
+    encode_indices( out, mesh, mesh.normal_indices );
+    encode_indices( out, mesh, mesh.texcoord_indices );
+
+    return out.bytes;
+}
+
+wavefront_obj_t decode_mesh( const std::uint8_t *data, std::size_t size ) {
+    reader_t in( data, size );
+    for ( std::uint8_t m : magic ) {
+        if ( in.u8() != m )
+            throw std::runtime_error( "Not a packed mesh." );
+    }
+    if ( in.u8() != version )
+        throw std::runtime_error( "Unsupported packed mesh version." );
+
+    wavefront_obj_t mesh;
+    mesh.is_flat = in.u8() != 0;
+    std::size_t vertex_count = in.u32();
+    std::size_t normal_count = in.u32();
+    std::size_t texcoord_count = in.u32();
+    std::size_t face_count = in.u32();
+    std::size_t corner_count = in.u32();
+    std::size_t material_count = in.u32();
+    in.need( material_count * min_material_bytes );
+    for ( std::size_t i = 0; i < material_count; ++i )
+        mesh.materials.push_back( decode_material( in ) );
+
+    double3 lo, hi;
+    double2 tlo, thi;
+    for ( int i = 0; i < 3; ++i ) {
+        lo[i] = in.f64();
+        hi[i] = in.f64();
+    }
+    for ( int i = 0; i < 2; ++i ) {
+        tlo[i] = in.f64();
+        thi[i] = in.f64();
+    }
+
+    // reject absurd counts before allocating for them
+    in.need( vertex_count * 6 + normal_count * 4 + texcoord_count * 4 + face_count * 2 + corner_count * 3 );
+    mesh.vertices.resize( vertex_count );
+    for ( auto &v : mesh.vertices ) {
+        for ( int i = 0; i < 3; ++i )
+            v[i] = dequantize( in.u16(), lo[i], hi[i] );
+    }
+    mesh.normals.resize( normal_count );
+    for ( auto &n : mesh.normals ) {
+        std::int16_t u = std::int16_t( in.u16() );
+        std::int16_t v = std::int16_t( in.u16() );
+        n = decode_octahedral( u, v );
+    }
+    mesh.texcoords.resize( texcoord_count );
+    for ( auto &t : mesh.texcoords ) {
+        for ( int i = 0; i < 2; ++i )
+            t[i] = dequantize( in.u16(), tlo[i], thi[i] );
+    }
+
+    mesh.faces.resize( face_count );
+    std::size_t corner = 0;
+    for ( auto &face : mesh.faces ) {
+        face.idx_begin = corner;
+        face.count = in.varint();
+        std::uint32_t material = in.varint();
+        if ( material > material_count )
+            throw std::runtime_error( "Corrupt packed mesh material index." );
+        face.material = int( material ) - 1;
+        if ( face.count > corner_count - corner )
+            throw std::runtime_error( "Corrupt packed mesh face list." );
+        corner += face.count;
+    }
+    if ( corner != corner_count )
+        throw std::runtime_error( "Corrupt packed mesh face list." );
+
+    decode_indices( in, mesh.vertex_indices, corner_count, vertex_count, "vertex" );
+    decode_indices( in, mesh.normal_indices, corner_count, normal_count, "normal" );
+    decode_indices( in, mesh.texcoord_indices, corner_count, texcoord_count, "texcoord" );
+
+    mesh.compute_face_normals();
+    mesh.sort_faces_by_material();
+    mesh.compute_bounds();
+    return mesh;
+}
+
+void save_mesh( const wavefront_obj_t &mesh, const char *path ) {
+    std::vector<std::uint8_t> bytes = encode_mesh( mesh );
+    std::ofstream file( path, std::ios::binary );
+    if ( !file || !file.write( reinterpret_cast<const char *>( bytes.data() ), bytes.size() ) )
+        throw std::runtime_error( "Cannot write file." );
+}
+
+wavefront_obj_t load_mesh( const char *path ) {
+    std::ifstream file( path, std::ios::binary | std::ios::ate );
+    if ( !file )
+        throw std::runtime_error( "Cannot open file." );
+
+    std::vector<std::uint8_t> bytes( std::size_t( file.tellg() ) );
+    file.seekg( 0 );
+    if ( !file.read( reinterpret_cast<char *>( bytes.data() ), bytes.size() ) )
+        throw std::runtime_error( "Cannot read file." );
+    return decode_mesh( bytes.data(), bytes.size() );
+}
@@ -0,0 +1,25 @@
+#ifndef _MESH_CODEC_H_
+#define _MESH_CODEC_H_
+
+#include <vector>
+#include <cstdint>
+#include "wavefront_obj.h"
+
+// Compact binary form of a wavefront_obj_t:
+//   materials   name, colors, shininess and diffuse map of each material
+//   positions   3 x 16 bit, quantised inside the mesh aabb
+//   normals     2 x 16 bit, octahedral encoding
+//   texcoords   2 x 16 bit, quantised inside their own bounding rectangle
+//   faces       vertex count and material + 1 per face as varints
+//   indices     vertex, normal and texcoord index streams, the corners of each
+//               face in turn, each delta coded against the previous index and
+//               stored as zigzag varints
+// Face normals are not stored; they are recomputed on decode.
+
+std::vector<std::uint8_t> encode_mesh( const wavefront_obj_t &mesh );
+wavefront_obj_t decode_mesh( const std::uint8_t *data, std::size_t size ); // throws std::runtime_error on bad data
+
+void save_mesh( const wavefront_obj_t &mesh, const char *path );
+wavefront_obj_t load_mesh( const char *path );
+
+#endif // _MESH_CODEC_H_
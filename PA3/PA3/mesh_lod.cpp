@@ -0,0 +1,408 @@
+#include <cmath>
+#include <array>
+#include <map>
+#include <queue>
+#include <limits>
+#include <iterator>
+#include <utility>
+#include <algorithm>
+#include "mesh_lod.h"
+
+namespace {
+
+using double3 = wavefront_obj_t::double3;
+using triangle_t = std::array<int, 3>;
+
+double3 sub( const double3 &a, const double3 &b ) {
+    return double3{ a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+}
+
+double3 cross( const double3 &a, const double3 &b ) {
+    return double3{ a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+}
+
+double dot( const double3 &a, const double3 &b ) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+double3 normalize( double3 u ) {
+    double l = std::sqrt( dot( u, u ) );
+    if ( l == 0 )
+        return u;
+    return double3{ u[0] / l, u[1] / l, u[2] / l };
+}
+
+double det3( double a, double b, double c,
+             double d, double e, double f,
+             double g, double h, double i ) {
+    return a * ( e * i - f * h ) - b * ( d * i - f * g ) + c * ( d * h - e * g );
+}
+
+// Symmetric 4x4 error quadric stored as its upper triangle:
+// a00 a01 a02 a03 a11 a12 a13 a22 a23 a33
+struct quadric_t {
+    double q[10];
+
+    quadric_t() {
+        std::fill( q, q + 10, 0.0 );
+    }
+
+    // add the squared distance to the plane n.x + d = 0, scaled by w
+    void add_plane( const double3 &n, double d, double w ) {
+        double a = n[0], b = n[1], c = n[2];
+        q[0] += w * a * a; q[1] += w * a * b; q[2] += w * a * c; q[3] += w * a * d;
+        q[4] += w * b * b; q[5] += w * b * c; q[6] += w * b * d;
+        q[7] += w * c * c; q[8] += w * c * d;
+        q[9] += w * d * d;
+    }
+
+    quadric_t &operator+=( const quadric_t &o ) {
+        for ( int i = 0; i < 10; ++i )
+            q[i] += o.q[i];
+        return *this;
+    }
+
+    double error( const double3 &v ) const {
+        double x = v[0], y = v[1], z = v[2];
+        return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+               + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+               + q[7] * z * z + 2 * q[8] * z
+               + q[9];
+    }
+
+    // position of minimal error, if the 3x3 system is not (nearly) singular
+    bool optimum( double3 &v ) const {
+        double det = det3( q[0], q[1], q[2], q[1], q[4], q[5], q[2], q[5], q[7] );
+        double scale = std::fabs( q[0] * q[4] * q[7] );
+        if ( det == 0 || std::fabs( det ) < 1e-9 * scale )
+            return false;
+
+        double bx = -q[3], by = -q[6], bz = -q[8];
+        v[0] = det3( bx, q[1], q[2], by, q[4], q[5], bz, q[5], q[7] ) / det;
+        v[1] = det3( q[0], bx, q[2], q[1], by, q[5], q[2], bz, q[7] ) / det;
+        v[2] = det3( q[0], q[1], bx, q[1], q[4], by, q[2], q[5], bz ) / det;
+        return true;
+    }
+};
+
+struct collapse_t {
+    double cost;
+    int keep, remove;
+    unsigned keep_stamp, remove_stamp;  // vertex stamps when this entry was queued
+    double3 target;
+
+    bool operator<( const collapse_t &o ) const {
+        return cost > o.cost;           // std::priority_queue pops the cheapest first
+    }
+};
+
+// Edge-collapse simplifier over an indexed triangle soup. Stale queue entries
+// are detected by per-vertex stamps instead of being removed from the heap.
+class decimator_t {
+public:
+    decimator_t( const wavefront_obj_t &mesh ) {
+        positions = mesh.vertices;
+        for ( auto &face : mesh.faces ) {
+            const int *idx = &mesh.vertex_indices[face.idx_begin];
+            bool valid = true;
+            for ( std::size_t i = 0; i < face.count; ++i )
+                valid = valid && idx[i] >= 0 && std::size_t( idx[i] ) < positions.size();
+            if ( !valid )
+                continue;
+            for ( std::size_t i = 1; i + 1 < face.count; ++i )
+                triangles.push_back( triangle_t{ idx[0], idx[i], idx[i + 1] } );
+        }
+
+        triangle_dead.assign( triangles.size(), 0 );
+        vertex_dead.assign( positions.size(), 0 );
+        stamps.assign( positions.size(), 0 );
+        vertex_triangles.resize( positions.size() );
+        quadrics.resize( positions.size() );
+        live = triangles.size();
+
+        std::map<std::pair<int, int>, int> edge_use;
+        for ( std::size_t t = 0; t < triangles.size(); ++t ) {
+            const triangle_t &tri = triangles[t];
+            double3 n = cross( sub( positions[tri[1]], positions[tri[0]] ), sub( positions[tri[2]], positions[tri[0]] ) );
+            double area = 0.5 * std::sqrt( dot( n, n ) );
+            n = normalize( n );
+            double d = -dot( n, positions[tri[0]] );
+
+            for ( int i = 0; i < 3; ++i ) {
+                vertex_triangles[tri[i]].push_back( int( t ) );
+                quadrics[tri[i]].add_plane( n, d, area );
+                ++edge_use[ordered( tri[i], tri[( i + 1 ) % 3] )];
+            }
+        }
+
+        // pin open boundaries with planes perpendicular to the border faces
+        for ( std::size_t t = 0; t < triangles.size(); ++t ) {
+            const triangle_t &tri = triangles[t];
+            double3 n = normalize( cross( sub( positions[tri[1]], positions[tri[0]] ), sub( positions[tri[2]], positions[tri[0]] ) ) );
+            for ( int i = 0; i < 3; ++i ) {
+                int a = tri[i], b = tri[( i + 1 ) % 3];
+                if ( edge_use[ordered( a, b )] != 1 )
+                    continue;
+                double3 e = sub( positions[b], positions[a] );
+                double3 p = normalize( cross( e, n ) );
+                double w = 1000 * dot( e, e );
+                quadrics[a].add_plane( p, -dot( p, positions[a] ), w );
+                quadrics[b].add_plane( p, -dot( p, positions[a] ), w );
+            }
+        }
+
+        for ( auto &edge : edge_use )
+            enqueue( edge.first.first, edge.first.second );
+    }
+
+    void run( std::size_t target_triangles ) {
+        while ( live > target_triangles && !heap.empty() ) {
+            collapse_t c = heap.top();
+            heap.pop();
+
+            if ( vertex_dead[c.keep] || vertex_dead[c.remove] )
+                continue;
+            if ( stamps[c.keep] != c.keep_stamp || stamps[c.remove] != c.remove_stamp )
+                continue;
+            if ( !collapsible( c ) )
+                continue;
+
+            collapse( c );
+        }
+    }
+
+    wavefront_obj_t result() const {
+        wavefront_obj_t out;
+        std::vector<int> remap( positions.size(), -1 );
+
+        for ( std::size_t t = 0; t < triangles.size(); ++t ) {
+            if ( triangle_dead[t] )
+                continue;
+
+            wavefront_obj_t::face_t face;
+            face.idx_begin = out.vertex_indices.size();
+            face.count = 3;
+            face.material = -1;
+            for ( int i = 0; i < 3; ++i ) {
+                int v = triangles[t][i];
+                if ( remap[v] < 0 ) {
+                    remap[v] = int( out.vertices.size() );
+                    out.vertices.push_back( positions[v] );
+                }
+                out.vertex_indices.push_back( remap[v] );
+                out.normal_indices.push_back( -1 );
+                out.texcoord_indices.push_back( -1 );
+            }
+            face.normal = triangle_normal( triangles[t] );
+            out.faces.push_back( face );
+        }
+
+        out.is_flat = true;
+        out.compute_bounds();
+        return out;
+    }
+
+private:
+    std::vector<double3> positions;
+    std::vector<triangle_t> triangles;
+    std::vector<char> triangle_dead, vertex_dead;
+    std::vector<unsigned> stamps;
+    std::vector<std::vector<int>> vertex_triangles;
+    std::vector<quadric_t> quadrics;
+    std::priority_queue<collapse_t> heap;
+    std::size_t live;
+
+    static std::pair<int, int> ordered( int a, int b ) {
+        return a < b ? std::make_pair( a, b ) : std::make_pair( b, a );
+    }
+
+    double3 triangle_normal( const triangle_t &tri ) const {
+        return normalize( cross( sub( positions[tri[1]], positions[tri[0]] ), sub( positions[tri[2]], positions[tri[0]] ) ) );
+    }
+
+    void enqueue( int a, int b ) {
+        quadric_t q = quadrics[a];
+        q += quadrics[b];
+
+        double3 mid;
+        for ( int i = 0; i < 3; ++i )
+            mid[i] = 0.5 * ( positions[a][i] + positions[b][i] );
+
+        collapse_t c;
+        c.keep = a;
+        c.remove = b;
+        c.keep_stamp = stamps[a];
+        c.remove_stamp = stamps[b];
+        c.target = mid;
+        c.cost = q.error( mid );
+
+        double3 candidates[3] = { positions[a], positions[b], mid };
+        if ( q.optimum( candidates[2] ) ) {
+            // trust the optimum only if it does not wander far off the edge
+            double3 e = sub( positions[b], positions[a] );
+            double3 o = sub( candidates[2], mid );
+            if ( dot( o, o ) > 4 * dot( e, e ) )
+                candidates[2] = mid;
+        }
+        for ( auto &p : candidates ) {
+            double cost = q.error( p );
+            if ( cost < c.cost ) {
+                c.cost = cost;
+                c.target = p;
+            }
+        }
+        c.cost = std::max( 0.0, c.cost );
+        heap.push( c );
+    }
+
+    void neighbours( int v, std::vector<int> &out ) const {
+        out.clear();
+        for ( int t : vertex_triangles[v] ) {
+            if ( triangle_dead[t] )
+                continue;
+            for ( int i = 0; i < 3; ++i ) {
+                if ( triangles[t][i] != v )
+                    out.push_back( triangles[t][i] );
+            }
+        }
+        std::sort( out.begin(), out.end() );
+        out.erase( std::unique( out.begin(), out.end() ), out.end() );
+    }
+
+    bool collapsible( const collapse_t &c ) {
+        // link condition: the only vertices adjacent to both ends are the
+        // opposite corners of the triangles on the edge, otherwise the
+        // collapse would pinch the surface into a non-manifold fan
+        std::vector<int> nk, nr, common;
+        neighbours( c.keep, nk );
+        neighbours( c.remove, nr );
+        std::set_intersection( nk.begin(), nk.end(), nr.begin(), nr.end(), std::back_inserter( common ) );
+
+        std::size_t shared = 0;
+        for ( int t : vertex_triangles[c.keep] ) {
+            if ( triangle_dead[t] )
+                continue;
+            const triangle_t &tri = triangles[t];
+            if ( tri[0] == c.remove || tri[1] == c.remove || tri[2] == c.remove )
+                ++shared;
+        }
+        if ( shared == 0 || common.size() > shared )
+            return false;
+
+        // reject collapses that flip or degenerate a surviving triangle
+        for ( int v : { c.keep, c.remove } ) {
+            for ( int t : vertex_triangles[v] ) {
+                if ( triangle_dead[t] )
+                    continue;
+                triangle_t tri = triangles[t];
+                bool has_keep = false, has_remove = false;
+                for ( int i = 0; i < 3; ++i ) {
+                    has_keep = has_keep || tri[i] == c.keep;
+                    has_remove = has_remove || tri[i] == c.remove;
+                }
+                if ( has_keep && has_remove )
+                    continue;
+
+                double3 before = triangle_normal( tri );
+                double3 p[3];
+                for ( int i = 0; i < 3; ++i )
+                    p[i] = ( tri[i] == v ) ? c.target : positions[tri[i]];
+                double3 after = cross( sub( p[1], p[0] ), sub( p[2], p[0] ) );
+                if ( dot( after, after ) == 0 || dot( before, normalize( after ) ) < 0.2 )
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    void collapse( const collapse_t &c ) {
+        positions[c.keep] = c.target;
+        quadrics[c.keep] += quadrics[c.remove];
+
+        for ( int t : vertex_triangles[c.remove] ) {
+            if ( triangle_dead[t] )
+                continue;
+            triangle_t &tri = triangles[t];
+            if ( tri[0] == c.keep || tri[1] == c.keep || tri[2] == c.keep ) {
+                triangle_dead[t] = 1;
+                --live;
+                continue;
+            }
+            for ( int i = 0; i < 3; ++i ) {
+                if ( tri[i] == c.remove )
+                    tri[i] = c.keep;
+            }
+            vertex_triangles[c.keep].push_back( t );
+        }
+        vertex_dead[c.remove] = 1;
+        vertex_triangles[c.remove].clear();
+
+        auto &kept = vertex_triangles[c.keep];
+        kept.erase( std::remove_if( kept.begin(), kept.end(), [this]( int t ) {
+            return triangle_dead[t] != 0;
+        } ), kept.end() );
+
+        ++stamps[c.keep];
+        std::vector<int> n;
+        neighbours( c.keep, n );
+        for ( int w : n )
+            enqueue( c.keep, w );
+    }
+};
+
+std::size_t triangle_count( const wavefront_obj_t &mesh ) {
+    std::size_t n = 0;
+    for ( auto &face : mesh.faces ) {
+        if ( face.count > 2 )
+            n += face.count - 2;
+    }
+    return n;
+}
+
+}
+
+wavefront_obj_t decimate( const wavefront_obj_t &mesh, std::size_t target_triangles ) {
+    decimator_t decimator( mesh );
+    decimator.run( target_triangles );
+    return decimator.result();
+}
+
+mesh_lod_t::mesh_lod_t( const wavefront_obj_t &source, const std::vector<double> &ratios,
+                        double full_detail_pixels, double crease_angle ) {
+    const double full = double( triangle_count( source ) );
+
+    levels.push_back( level_t{ &source, 1.0, full_detail_pixels } );
+    for ( double ratio : ratios ) {
+        if ( ratio >= levels.back().ratio || ratio <= 0 )
+            continue;
+
+        std::unique_ptr<wavefront_obj_t> mesh( new wavefront_obj_t( decimate( *levels.back().mesh, std::size_t( ratio * full ) ) ) );
+        mesh->compute_smooth_normals( crease_angle );
+
+        level_t level;
+        level.mesh = mesh.get();
+        level.ratio = full > 0 ? triangle_count( *mesh ) / full : ratio;
+        level.min_pixels = full_detail_pixels * std::sqrt( ratio );
+        levels.push_back( level );
+        decimated.push_back( std::move( mesh ) );
+    }
+}
+
+std::size_t mesh_lod_t::select( double projected_pixels ) const {
+    for ( std::size_t i = 0; i < levels.size(); ++i ) {
+        if ( projected_pixels >= levels[i].min_pixels )
+            return i;
+    }
+    return levels.size() - 1;
+}
+
+double mesh_lod_t::projected_size( const std::pair<double3, double3> &aabb, double scale,
+                                   double eye_depth, double fovy, int viewport_height ) {
+    double3 diagonal = sub( aabb.second, aabb.first );
+    double radius = 0.5 * scale * std::sqrt( dot( diagonal, diagonal ) );
+    if ( eye_depth <= radius )
+        return std::numeric_limits<double>::infinity();
+
+    double t = std::tan( 0.5 * fovy * std::acos( -1.0 ) / 180.0 );
+    return radius * viewport_height / ( eye_depth * t );
+}
@@ -0,0 +1,49 @@
+#ifndef _MESH_LOD_H_
+#define _MESH_LOD_H_
+
+#include <vector>
+#include <cstddef>
+#include <memory>
+#include "wavefront_obj.h"
+
+// Quadric error metric (Garland-Heckbert) decimation of a wavefront_obj_t into
+// a chain of levels of detail, plus the screen-size rule used to pick one.
+class mesh_lod_t {
+public:
+	using double3 = wavefront_obj_t::double3;
+
+	struct level_t {
+		const wavefront_obj_t *mesh;    // the source at level 0; past it triangulated, positions and smooth normals only
+		double ratio;           // triangle count relative to level 0
+		double min_pixels;      // smallest projected size this level is used for
+	};
+	std::vector<level_t> levels; // levels[0] is the full resolution mesh
+
+	// Build one level per entry of ratios (e.g. {1, 0.5, 0.2, 0.05}), each
+	// decimated from the previous one. full_detail_pixels is the projected size
+	// at and above which level 0 is drawn; coarser levels switch in at
+	// full_detail_pixels * sqrt( ratio ), since edge length grows roughly with
+	// 1 / sqrt( triangle count ). source must outlive this object.
+	mesh_lod_t( const wavefront_obj_t &source, const std::vector<double> &ratios,
+	            double full_detail_pixels = 600, double crease_angle = 45 );
+
+	mesh_lod_t( const mesh_lod_t & ) = delete;
+	mesh_lod_t &operator=( const mesh_lod_t & ) = delete;
+
+	// Index of the level to draw for an object covering projected_pixels.
+	std::size_t select( double projected_pixels ) const;
+
+	// Projected diameter in pixels of the bounding sphere of aabb, scaled by
+	// scale, whose center lies at eye_depth in front of a perspective camera
+	// with vertical field of view fovy (degrees) and a viewport_height pixels.
+	static double projected_size( const std::pair<double3, double3> &aabb, double scale,
+	                              double eye_depth, double fovy, int viewport_height );
+
+private:
+	std::vector<std::unique_ptr<wavefront_obj_t>> decimated;   // levels past 0
+};
+
+// Simplify mesh to at most target_triangles triangles by edge collapse.
+wavefront_obj_t decimate( const wavefront_obj_t &mesh, std::size_t target_triangles );
+
+#endif // _MESH_LOD_H_
@@ -0,0 +1,184 @@
+#ifndef _RIGID_XFORM_H_
+#define _RIGID_XFORM_H_
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "mat4.h"
+
+// Unit quaternion w + xi + yj + zk for rotations. Composition is 16
+// multiplies instead of the 64 of a 4x4 product, and renormalizing keeps it
+// exactly a rotation however many increments are applied.
+struct quat_t {
+	using double3 = mat4_t::double3;
+
+	double w, x, y, z;
+
+	constexpr quat_t() : w( 1 ), x( 0 ), y( 0 ), z( 0 ) {}
+	constexpr quat_t( double w, double x, double y, double z ) : w( w ), x( x ), y( y ), z( z ) {}
+
+	// Rotation by angle degrees about axis (x, y, z), as glRotated.
+	static quat_t axis_angle( double angle, double ax, double ay, double az ) {
+		double l = std::sqrt( ax * ax + ay * ay + az * az );
+		if ( l == 0 )
+			return quat_t();
+		double half = angle * 3.14159265358979323846 / 360;
+		double s = std::sin( half ) / l;
+		return quat_t( std::cos( half ), ax * s, ay * s, az * s );
+	}
+
+	// Rotation part of m; m must be a rotation, possibly uniformly scaled.
+	static quat_t from_mat4( const mat4_t &m ) {
+		double s = std::sqrt( m( 0, 0 ) * m( 0, 0 ) + m( 1, 0 ) * m( 1, 0 ) + m( 2, 0 ) * m( 2, 0 ) );
+		if ( s == 0 )
+			return quat_t();
+		double r00 = m( 0, 0 ) / s, r11 = m( 1, 1 ) / s, r22 = m( 2, 2 ) / s;
+		double trace = r00 + r11 + r22;
+		quat_t q;
+		// Shepperd: divide by the largest of the four candidates for accuracy
+		if ( trace > 0 ) {
+			double t = 2 * std::sqrt( 1 + trace );
+			q = quat_t( t / 4, ( m( 2, 1 ) - m( 1, 2 ) ) / ( s * t ), ( m( 0, 2 ) - m( 2, 0 ) ) / ( s * t ), ( m( 1, 0 ) - m( 0, 1 ) ) / ( s * t ) );
+		} else if ( r00 > r11 && r00 > r22 ) {
+			double t = 2 * std::sqrt( 1 + r00 - r11 - r22 );
+			q = quat_t( ( m( 2, 1 ) - m( 1, 2 ) ) / ( s * t ), t / 4, ( m( 0, 1 ) + m( 1, 0 ) ) / ( s * t ), ( m( 0, 2 ) + m( 2, 0 ) ) / ( s * t ) );
+		} else if ( r11 > r22 ) {
+			double t = 2 * std::sqrt( 1 + r11 - r00 - r22 );
+			q = quat_t( ( m( 0, 2 ) - m( 2, 0 ) ) / ( s * t ), ( m( 0, 1 ) + m( 1, 0 ) ) / ( s * t ), t / 4, ( m( 1, 2 ) + m( 2, 1 ) ) / ( s * t ) );
+		} else {
+			double t = 2 * std::sqrt( 1 + r22 - r00 - r11 );
+			q = quat_t( ( m( 1, 0 ) - m( 0, 1 ) ) / ( s * t ), ( m( 0, 2 ) + m( 2, 0 ) ) / ( s * t ), ( m( 1, 2 ) + m( 2, 1 ) ) / ( s * t ), t / 4 );
+		}
+		return q.normalized();
+	}
+
+	// this rotation after b
+	constexpr quat_t operator*( const quat_t &b ) const {
+		return quat_t( w * b.w - x * b.x - y * b.y - z * b.z,
+		               w * b.x + x * b.w + y * b.z - z * b.y,
+		               w * b.y - x * b.z + y * b.w + z * b.x,
+		               w * b.z + x * b.y - y * b.x + z * b.w );
+	}
+
+	constexpr quat_t conjugate() const {
+		return quat_t( w, -x, -y, -z );
+	}
+
+	quat_t normalized() const {
+		double l = std::sqrt( w * w + x * x + y * y + z * z );
+		if ( l == 0 )
+			return quat_t();
+		return quat_t( w / l, x / l, y / l, z / l );
+	}
+
+	double3 rotate( const double3 &v ) const {
+		// v + 2w (u x v) + 2 u x (u x v), with u = (x, y, z)
+		double tx = 2 * ( y * v[2] - z * v[1] );
+		double ty = 2 * ( z * v[0] - x * v[2] );
+		double tz = 2 * ( x * v[1] - y * v[0] );
+		return double3{ v[0] + w * tx + y * tz - z * ty,
+		                v[1] + w * ty + z * tx - x * tz,
+		                v[2] + w * tz + x * ty - y * tx };
+	}
+
+	// Shortest-path spherical interpolation from a (t = 0) to b (t = 1).
+	static quat_t slerp( const quat_t &a, quat_t b, double t ) {
+		double c = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+		if ( c < 0 ) {
+			b = quat_t( -b.w, -b.x, -b.y, -b.z );
+			c = -c;
+		}
+		double ka = 1 - t, kb = t;
+		if ( c < 0.9995 ) {
+			double angle = std::acos( c ), s = std::sin( angle );
+			ka = std::sin( ka * angle ) / s;
+			kb = std::sin( kb * angle ) / s;
+		}
+		return quat_t( ka * a.w + kb * b.w, ka * a.x + kb * b.x, ka * a.y + kb * b.y, ka * a.z + kb * b.z ).normalized();
+	}
+};
+
+// Rotation, then uniform scale, then translation: p -> translation + scale * rotation(p).
+// Composition and inversion stay in this form, so the result is always a
+// similarity transform; to_mat4() gives the matrix for GL or FrameXform.
+struct rigid_xform_t {
+	using double3 = mat4_t::double3;
+
+	// composition renormalizes the rotation after this many steps
+	static constexpr std::uint32_t renormalize_interval = 64;
+
+	quat_t rotation;
+	double3 translation{ { 0, 0, 0 } };
+	double scale = 1;
+	std::uint32_t compositions = 0;
+
+	rigid_xform_t() {}
+	rigid_xform_t( const quat_t &rotation, const double3 &translation = double3{ { 0, 0, 0 } }, double scale = 1 )
+		: rotation( rotation ), translation( translation ), scale( scale ) {}
+
+	static rigid_xform_t translate( double x, double y, double z ) {
+		return rigid_xform_t( quat_t(), double3{ { x, y, z } } );
+	}
+
+	static rigid_xform_t rotate( double angle, double x, double y, double z ) {
+		return rigid_xform_t( quat_t::axis_angle( angle, x, y, z ) );
+	}
+
+	// m must be a rotation with uniform scale and a translation.
+	static rigid_xform_t from_mat4( const mat4_t &m ) {
+		double s = std::sqrt( m( 0, 0 ) * m( 0, 0 ) + m( 1, 0 ) * m( 1, 0 ) + m( 2, 0 ) * m( 2, 0 ) );
+		return rigid_xform_t( quat_t::from_mat4( m ), double3{ { m.m[12], m.m[13], m.m[14] } }, s );
+	}
+
+	double3 transform_point( const double3 &p ) const {
+		double3 r = rotation.rotate( p );
+		return double3{ { translation[0] + scale * r[0], translation[1] + scale * r[1], translation[2] + scale * r[2] } };
+	}
+
+	// this transform after b
+	rigid_xform_t operator*( const rigid_xform_t &b ) const {
+		rigid_xform_t r( rotation * b.rotation, transform_point( b.translation ), scale * b.scale );
+		r.compositions = std::max( compositions, b.compositions ) + 1;
+		if ( r.compositions >= renormalize_interval )
+			r.renormalize();
+		return r;
+	}
+
+	rigid_xform_t &operator*=( const rigid_xform_t &b ) {
+		return *this = *this * b;
+	}
+
+	rigid_xform_t inverse() const {
+		quat_t q = rotation.conjugate();
+		double s = scale == 0 ? 0 : 1 / scale;
+		double3 t = q.rotate( translation );
+		return rigid_xform_t( q, double3{ { -s * t[0], -s * t[1], -s * t[2] } }, s );
+	}
+
+	void renormalize() {
+		rotation = rotation.normalized();
+		compositions = 0;
+	}
+
+	mat4_t to_mat4() const {
+		const quat_t &q = rotation;
+		double xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+		double xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+		double wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+		double s = scale;
+		return mat4_t( s * ( 1 - 2 * ( yy + zz ) ), s * 2 * ( xy + wz ), s * 2 * ( xz - wy ), 0,
+		               s * 2 * ( xy - wz ), s * ( 1 - 2 * ( xx + zz ) ), s * 2 * ( yz + wx ), 0,
+		               s * 2 * ( xz + wy ), s * 2 * ( yz - wx ), s * ( 1 - 2 * ( xx + yy ) ), 0,
+		               translation[0], translation[1], translation[2], 1 );
+	}
+
+	// Rotation by slerp, translation and scale linearly; t = 0 gives a.
+	static rigid_xform_t interpolate( const rigid_xform_t &a, const rigid_xform_t &b, double t ) {
+		double3 p;
+		for ( int i = 0; i < 3; ++i )
+			p[i] = a.translation[i] + t * ( b.translation[i] - a.translation[i] );
+		return rigid_xform_t( quat_t::slerp( a.rotation, b.rotation, t ), p, a.scale + t * ( b.scale - a.scale ) );
+	}
+};
+
+#endif // _RIGID_XFORM_H_
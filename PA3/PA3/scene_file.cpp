@@ -0,0 +1,286 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/stat.h>
+#include "mesh_codec.h"
+#include "scene_file.h"
+
+namespace {
+
+using double3 = scene_file_t::double3;
+
+const std::size_t max_lights = 8;       // GL_LIGHT0 to GL_LIGHT7
+
+// Read the operands of transform op word from in. False if word is not an op
+// or its operands are missing.
+bool read_op( const std::string &word, std::istream &in, scene_file_t::transform_t &transform ) {
+    scene_file_t::transform_t::op_t op{};
+    int count;
+    if ( word == "translate" ) {
+        op.kind = scene_file_t::transform_t::op_t::translate;
+        count = 3;
+    } else if ( word == "rotate" ) {
+        op.kind = scene_file_t::transform_t::op_t::rotate;
+        count = 4;
+    } else if ( word == "scale" ) {
+        op.kind = scene_file_t::transform_t::op_t::scale;
+        count = 1;
+    } else if ( word == "ground" ) {
+        op.kind = scene_file_t::transform_t::op_t::ground;
+        count = 0;
+    } else
+        return false;
+    for ( int k = 0; k < count; k++ ) {
+        if ( !( in >> op.values[k] ) )
+            return false;
+    }
+    if ( op.kind == scene_file_t::transform_t::op_t::scale && op.values[0] <= 0 )
+        return false;
+    transform.ops.push_back( op );
+    return true;
+}
+
+// Seconds since the epoch path was last written, or -1 if it cannot be read.
+long long modified_time( const std::string &path ) {
+    struct stat info;
+    if ( stat( path.c_str(), &info ) != 0 )
+        return -1;
+    return ( long long )info.st_mtime;
+}
+
+// A mesh cache file: the files the mesh was read from besides the .obj, each
+// as a u32 length, its path and its i64 modification time, after a u32 count;
+// then the mesh in mesh_codec form.
+std::vector<std::uint8_t> cache_header( const std::vector<std::string> &dependencies ) {
+    std::vector<std::uint8_t> bytes;
+    auto put = [&]( std::uint64_t v, int size ) {
+        for ( int i = 0; i < size; ++i )
+            bytes.push_back( std::uint8_t( v >> ( 8 * i ) ) );
+    };
+    put( dependencies.size(), 4 );
+    for ( const std::string &path : dependencies ) {
+        put( path.size(), 4 );
+        bytes.insert( bytes.end(), path.begin(), path.end() );
+        put( std::uint64_t( modified_time( path ) ), 8 );
+    }
+    return bytes;
+}
+
+// Offset of the mesh in a cache file, or 0 if the header is cut short or any
+// file it lists has changed since the cache was written.
+std::size_t cache_mesh_offset( const std::vector<std::uint8_t> &bytes ) {
+    std::size_t at = 0;
+    auto get = [&]( int size, std::uint64_t &v ) {
+        if ( bytes.size() - at < std::size_t( size ) )
+            return false;
+        v = 0;
+        for ( int i = 0; i < size; ++i )
+            v |= std::uint64_t( bytes[at++] ) << ( 8 * i );
+        return true;
+    };
+    std::uint64_t count, length, time;
+    if ( !get( 4, count ) )
+        return 0;
+    for ( std::uint64_t k = 0; k < count; ++k ) {
+        if ( !get( 4, length ) || bytes.size() - at < length )
+            return 0;
+        std::string path( bytes.begin() + at, bytes.begin() + at + length );
+        at += length;
+        if ( !get( 8, time ) || ( long long )time != modified_time( path ) )
+            return 0;
+    }
+    return at;
+}
+
+} // namespace
+
+rigid_xform_t scene_file_t::transform_t::resolve( const std::pair<double3, double3> &aabb ) const {
+    // Right to left, so ground knows where the ops applied before it put the mesh.
+    rigid_xform_t inner;
+    for ( auto op = ops.rbegin(); op != ops.rend(); ++op ) {
+        const double *v = op->values;
+        switch ( op->kind ) {
+        case op_t::translate:
+            inner = rigid_xform_t::translate( v[0], v[1], v[2] ) * inner;
+            break;
+        case op_t::rotate:
+            inner = rigid_xform_t::rotate( v[0], v[1], v[2], v[3] ) * inner;
+            break;
+        case op_t::scale:
+            inner = rigid_xform_t( quat_t(), double3{ { 0, 0, 0 } }, v[0] ) * inner;
+            break;
+        case op_t::ground: {
+            double lowest = 0;
+            for ( int corner = 0; corner < 8; corner++ ) {
+                double3 p{ { ( corner & 1 ? aabb.second : aabb.first )[0],
+                             ( corner & 2 ? aabb.second : aabb.first )[1],
+                             ( corner & 4 ? aabb.second : aabb.first )[2] } };
+                double y = inner.transform_point( p )[1];
+                lowest = corner == 0 ? y : std::min( lowest, y );
+            }
+            inner = rigid_xform_t::translate( 0, -lowest, 0 ) * inner;
+            break;
+        }
+        }
+    }
+    return inner;
+}
+
+scene_file_t::scene_file_t( const char *path ) {
+    std::ifstream file( path );
+    if ( !file )
+        throw std::runtime_error( "Cannot open file." );
+
+    // Mesh paths are relative to the scene file.
+    std::string file_path = path, directory;
+    std::size_t slash = file_path.find_last_of( "/\\" );
+    if ( slash != std::string::npos )
+        directory = file_path.substr( 0, slash + 1 );
+
+    std::string line;
+    for ( int number = 1; std::getline( file, line ); number++ ) {
+        std::istringstream in( line.substr( 0, line.find( '#' ) ) );
+        std::string directive, word;
+        if ( !( in >> directive ) )
+            continue;
+
+        bool ok = true;
+        std::string problem;
+        if ( directive == "mesh" ) {
+            mesh_t mesh;
+            ok = bool( in >> mesh.name >> mesh.path );
+            while ( ok && in >> word )
+                ok = word == "smooth" && bool( in >> mesh.smooth_angle );
+            if ( ok && find_mesh( mesh.name ) >= 0 )
+                problem = "Mesh " + mesh.name + " is declared twice";
+            if ( ok && !directory.empty() && mesh.path[0] != '/' && mesh.path[0] != '\\' && mesh.path.find( ':' ) == std::string::npos )
+                mesh.path = directory + mesh.path;
+            meshes.push_back( mesh );
+        } else if ( directive == "instance" ) {
+            instance_t instance;
+            ok = bool( in >> instance.name >> word );
+            if ( ok && ( instance.mesh = find_mesh( word ) ) < 0 )
+                problem = "Unknown mesh " + word;
+            while ( ok && in >> word ) {
+                if ( word == "color" )
+                    ok = instance.color_set = bool( in >> instance.color[0] >> instance.color[1] >> instance.color[2] );
+                else
+                    ok = read_op( word, in, instance.transform );
+            }
+            instances.push_back( instance );
+        } else if ( directive == "camera" ) {
+            camera_t camera;
+            ok = bool( in >> camera.eye[0] >> camera.eye[1] >> camera.eye[2]
+                          >> camera.center[0] >> camera.center[1] >> camera.center[2]
+                          >> camera.up[0] >> camera.up[1] >> camera.up[2] ) && !( in >> word );
+            cameras.push_back( camera );
+        } else if ( directive == "camera_model" ) {
+            ok = bool( in >> word );
+            if ( ok && ( camera_mesh = find_mesh( word ) ) < 0 )
+                problem = "Unknown mesh " + word;
+            camera_model.ops.clear();
+            while ( ok && in >> word )
+                ok = read_op( word, in, camera_model );
+        } else if ( directive == "light" ) {
+            light_t light;
+            ok = bool( in >> light.direction[0] >> light.direction[1] >> light.direction[2] );
+            while ( ok && in >> word ) {
+                if ( word == "ambient" )
+                    ok = bool( in >> light.ambient );
+                else if ( word == "diffuse" )
+                    ok = bool( in >> light.diffuse );
+                else
+                    ok = false;
+            }
+            if ( ok && lights.size() == max_lights )
+                problem = "Too many lights";
+            lights.push_back( light );
+        } else
+            problem = "Unknown directive " + directive;
+
+        if ( !ok )
+            problem = "Bad " + directive;
+        if ( !problem.empty() )
+            throw std::runtime_error( problem + " on line " + std::to_string( number ) + "." );
+    }
+}
+
+std::string scene_file_t::mesh_t::asset_key() const {
+    // Scene files are read by line, so no path has a line break in it.
+    if ( smooth_angle < 0 )
+        return path;
+    std::ostringstream key;
+    key.precision( 17 );
+    key << path << '\n' << smooth_angle;
+    return key.str();
+}
+
+int scene_file_t::find_mesh( const std::string &name ) const {
+    for ( std::size_t i = 0; i < meshes.size(); i++ ) {
+        if ( meshes[i].name == name )
+            return int( i );
+    }
+    return -1;
+}
+
+int scene_file_t::find_instance( const std::string &name ) const {
+    for ( std::size_t i = 0; i < instances.size(); i++ ) {
+        if ( instances[i].name == name )
+            return int( i );
+    }
+    return -1;
+}
+
+std::shared_ptr<wavefront_obj_t> load_mesh_cached( const std::string &path ) {
+    std::string cache = path + ".pmsh";
+    long long source_time = modified_time( path ), cache_time = modified_time( cache );
+    if ( cache_time >= 0 && cache_time > source_time ) {
+        auto start = std::chrono::steady_clock::now();
+        std::ifstream file( cache, std::ios::binary | std::ios::ate );
+        std::vector<std::uint8_t> bytes( file ? std::size_t( file.tellg() ) : 0 );
+        file.seekg( 0 );
+        std::size_t offset = file.read( reinterpret_cast<char *>( bytes.data() ), bytes.size() ) ? cache_mesh_offset( bytes ) : 0;
+        if ( offset > 0 ) {
+            try {
+                auto mesh = std::make_shared<wavefront_obj_t>( decode_mesh( bytes.data() + offset, bytes.size() - offset ) );
+                mesh->stats.io_ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+                return mesh;
+            } catch ( std::runtime_error & ) {
+                // Written by another version of the codec; rebuild it.
+            }
+        }
+    }
+
+    wavefront_obj_t parsed( path.c_str() );
+    std::vector<std::uint8_t> mesh_bytes = encode_mesh( parsed );
+    std::vector<std::uint8_t> bytes = cache_header( parsed.material_libraries );
+    bytes.insert( bytes.end(), mesh_bytes.begin(), mesh_bytes.end() );
+
+    // Write beside the cache and rename, so a concurrent start never reads half a file.
+    std::string partial = cache + ".partial";
+    std::ofstream file( partial, std::ios::binary );
+    file.write( reinterpret_cast<const char *>( bytes.data() ), bytes.size() );
+    file.close();
+    if ( file ) {
+        std::remove( cache.c_str() );
+        std::rename( partial.c_str(), cache.c_str() );
+    } else
+        std::remove( partial.c_str() );
+
+    // Hand out what the cache holds, not the parse, so every start draws the same mesh.
+    auto mesh = std::make_shared<wavefront_obj_t>( decode_mesh( mesh_bytes.data(), mesh_bytes.size() ) );
+    mesh->stats = parsed.stats;
+    return mesh;
+}
+
+std::shared_ptr<wavefront_obj_t> load_scene_mesh( const std::string &key, bool cached ) {
+    std::size_t split = key.find( '\n' );
+    std::string path = key.substr( 0, split );
+    auto mesh = cached ? load_mesh_cached( path ) : std::make_shared<wavefront_obj_t>( path.c_str() );
+    if ( split != std::string::npos && mesh->is_flat )
+        mesh->compute_smooth_normals( std::stod( key.substr( split + 1 ) ) );
+    return mesh;
+}
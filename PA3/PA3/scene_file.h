@@ -0,0 +1,98 @@
+#ifndef _SCENE_FILE_H_
+#define _SCENE_FILE_H_
+
+#include <array>
+#include <string>
+#include <vector>
+#include <memory>
+#include "rigid_xform.h"
+#include "wavefront_obj.h"
+
+// Text description of a scene, one directive per line; '#' starts a comment.
+//   mesh <name> <path> [smooth <degrees>]
+//       a model, relative to the scene file. A model without normals is
+//       smoothed, keeping edges sharper than degrees.
+//   instance <name> <mesh> [color r g b] <transform>
+//       a copy of a mesh placed in the world. Without color, a mesh with
+//       mtllib materials is drawn in them, and light gray where it has none;
+//       with it, the whole mesh is drawn in color. The software renderer
+//       always draws in color.
+//   camera ex ey ez cx cy cz ux uy uz
+//       a camera placed as gluLookAt( eye, center, up ) would place it.
+//   camera_model <mesh> <transform>
+//       what every camera is drawn as, placed in the camera's frame.
+//   light dx dy dz [ambient a] [diffuse d]
+//       a directional light shining from direction, up to eight of them.
+// A transform is a list of
+//   translate x y z | rotate degrees x y z | scale s | ground
+// multiplied in the order written, like the glTranslate and glRotate calls
+// would be, so the last one applies to the mesh first. ground translates
+// the mesh up or down until its lowest point is at y = 0.
+class scene_file_t {
+public:
+	using double3 = rigid_xform_t::double3;
+
+	struct transform_t {
+		struct op_t {
+			enum kind_t { translate, rotate, scale, ground } kind;
+			double values[4];
+		};
+		std::vector<op_t> ops;
+
+		// The transform for a mesh with this bounding box.
+		rigid_xform_t resolve( const std::pair<double3, double3> &aabb ) const;
+	};
+	struct mesh_t {
+		std::string name;
+		std::string path;           // as given, joined to the scene file's directory
+		double smooth_angle = -1;   // degrees, or negative to leave a mesh without normals flat
+
+		// Name of this mesh for load_scene_mesh(): the path, and the smoothing
+		// angle if there is one, so one file smoothed two ways is two assets.
+		std::string asset_key() const;
+	};
+	struct instance_t {
+		std::string name;
+		int mesh;                   // index into meshes
+		std::array<float, 4> color{ { 0.8f, 0.8f, 0.8f, 1.0f } };
+		bool color_set = false;     // color was given, so it replaces the mesh's materials
+		transform_t transform;
+	};
+	struct camera_t {
+		double3 eye, center, up;
+	};
+	struct light_t {
+		double3 direction{ { 1, 1, 1 } };
+		float ambient = 0.1f;
+		float diffuse = 0.9f;
+	};
+
+	std::vector<mesh_t> meshes;
+	std::vector<instance_t> instances;
+	std::vector<camera_t> cameras;
+	int camera_mesh = -1;           // index into meshes, or -1 without camera_model
+	transform_t camera_model;
+	std::vector<light_t> lights;
+
+	// Throws std::runtime_error naming the line of the first mistake.
+	explicit scene_file_t( const char *path );
+
+	int find_mesh( const std::string &name ) const;            // -1 if there is none
+	int find_instance( const std::string &name ) const;        // -1 if there is none
+};
+
+// Loader for asset_cache_t. Reads the binary mesh_codec form cached next to
+// path as path + ".pmsh" when it is newer than path and the material
+// libraries it names have not changed since; otherwise parses path and
+// writes that cache for the next start. The cache is quantised to 16
+// bits in the mesh's bounding box, so a fresh parse is passed through the
+// same encoding before it is returned: the mesh is the same whether or not
+// the cache existed. Failing to write it is not an error.
+std::shared_ptr<wavefront_obj_t> load_mesh_cached( const std::string &path );
+
+// Loader for asset_cache_t keyed by mesh_t::asset_key(). Reads the mesh with
+// load_mesh_cached(), or straight from its file if cached is false, and
+// smooths it on the loading thread as the key says.
+std::shared_ptr<wavefront_obj_t> load_scene_mesh( const std::string &key, bool cached );
+
+#endif // _SCENE_FILE_H_
@@ -0,0 +1,49 @@
+#include <algorithm>
+#include <stdexcept>
+#include "scene_graph.h"
+
+int scene_graph_t::add_node( int parent, const rigid_xform_t &local, const std::string &name ) {
+    if ( parent != none && ( parent < 0 || std::size_t( parent ) >= size() ) )
+        throw std::runtime_error( "Scene node parent does not exist." );
+
+    int node = int( size() );
+    parents.push_back( parent );
+    names.push_back( name );
+    locals.push_back( local );
+    worlds.push_back( mat4_t() );
+    dirty.push_back( 1 );
+    first_dirty = std::min( first_dirty, std::size_t( node ) );
+    return node;
+}
+
+void scene_graph_t::set_local( int node, const rigid_xform_t &local ) {
+    locals[node] = local;
+    dirty[node] = 1;
+    first_dirty = std::min( first_dirty, std::size_t( node ) );
+}
+
+//------------------------------------------------------------------------------
+// Parents come before children, so a dirty flag pushed down to the children
+// during the pass is always seen before they are visited.
+void scene_graph_t::update() {
+    updated = 0;
+    if ( first_dirty == clean )
+        return;
+
+    for ( std::size_t i = first_dirty; i < size(); ++i ) {
+        int p = parents[i];
+        if ( p != none && dirty[p] )
+            dirty[i] = 1;
+        if ( !dirty[i] )
+            continue;
+        worlds[i] = p == none ? locals[i].to_mat4() : worlds[p] * locals[i].to_mat4();
+        ++updated;
+    }
+    std::fill( dirty.begin() + first_dirty, dirty.end(), 0 );
+    first_dirty = clean;
+}
+
+int scene_graph_t::find( const std::string &name ) const {
+    auto found = std::find( names.begin(), names.end(), name );
+    return found == names.end() ? none : int( found - names.begin() );
+}
@@ -0,0 +1,63 @@
+#ifndef _SCENE_GRAPH_H_
+#define _SCENE_GRAPH_H_
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "mat4.h"
+#include "rigid_xform.h"
+
+// Transform hierarchy stored as parallel arrays indexed by node id. A node is
+// always added after its parent, so one forward pass over the arrays visits
+// every parent before its children. World matrices are cached and rebuilt
+// only for nodes whose local transform, or an ancestor's, changed since the
+// last update(); a frame where nothing moved costs a single flag test.
+class scene_graph_t {
+public:
+	static constexpr int none = -1;
+
+	std::vector<int> parents;               // parent of each node, or none for a root
+	std::vector<std::string> names;
+	std::vector<rigid_xform_t> locals;      // node to parent
+	std::vector<mat4_t> worlds;             // node to world, valid after update()
+
+	// Add a node under parent (none for a root) and return its id.
+	int add_node( int parent, const rigid_xform_t &local = rigid_xform_t(), const std::string &name = std::string() );
+
+	const rigid_xform_t &local( int node ) const {
+		return locals[node];
+	}
+
+	void set_local( int node, const rigid_xform_t &local );
+
+	// World matrix of node, bringing the cache up to date first if needed.
+	const mat4_t &world( int node ) {
+		if ( first_dirty != clean )
+			update();
+		return worlds[node];
+	}
+
+	// Recompute the world matrices of changed nodes and their descendants.
+	void update();
+
+	// First node with the given name, or none.
+	int find( const std::string &name ) const;
+
+	std::size_t size() const {
+		return parents.size();
+	}
+
+	// Number of world matrices recomputed by the last update().
+	std::size_t last_update_count() const {
+		return updated;
+	}
+
+private:
+	static constexpr std::size_t clean = std::size_t( -1 );
+
+	std::vector<std::uint8_t> dirty;        // local changed, or (during update) an ancestor did
+	std::size_t first_dirty = clean;        // lowest dirty id; update() starts there
+	std::size_t updated = 0;
+};
+
+#endif // _SCENE_GRAPH_H_
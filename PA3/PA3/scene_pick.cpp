@@ -0,0 +1,259 @@
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include "scene_pick.h"
+
+namespace {
+
+using double3 = mat4_t::double3;
+
+double dot( const double3 &a, const double3 &b ) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Does origin + t * dir pass through the sphere for some 0 <= t <= t_max?
+bool ray_meets_sphere( const double3 &origin, const double3 &dir, const double3 &center, double radius, double t_max ) {
+    double3 oc{ center[0] - origin[0], center[1] - origin[1], center[2] - origin[2] };
+    double t = std::min( t_max, std::max( 0.0, dot( oc, dir ) / dot( dir, dir ) ) );   // closest point of the segment
+    double3 d{ origin[0] + t * dir[0] - center[0], origin[1] + t * dir[1] - center[1], origin[2] + t * dir[2] - center[2] };
+    return dot( d, d ) <= radius * radius;
+}
+
+// World-space bounding sphere of a target's model-space root box.
+void bounding_sphere( const pick_target_t &target, double3 &center, double &radius ) {
+    const mesh_bvh_t::node_t &root = target.bvh->root();
+    double3 half;
+    for ( int i = 0; i < 3; ++i ) {
+        center[i] = 0.5 * ( root.lo[i] + root.hi[i] );
+        half[i] = 0.5 * ( root.hi[i] - root.lo[i] );
+    }
+    double3 axis_x = target.world.transform_vector( double3{ 1, 0, 0 } );
+    double3 axis_y = target.world.transform_vector( double3{ 0, 1, 0 } );
+    double3 axis_z = target.world.transform_vector( double3{ 0, 0, 1 } );
+    double scale = std::sqrt( std::max( dot( axis_x, axis_x ), std::max( dot( axis_y, axis_y ), dot( axis_z, axis_z ) ) ) );
+    radius = scale * std::sqrt( dot( half, half ) );
+    center = target.world.transform_point( center );
+}
+
+// Plane p carried back through m: x is inside the result when m * x is inside p.
+mesh_bvh_t::plane_t pull_back( const mesh_bvh_t::plane_t &p, const mat4_t &m ) {
+    mesh_bvh_t::plane_t r;
+    for ( int j = 0; j < 4; ++j )
+        r[j] = p[0] * m( 0, j ) + p[1] * m( 1, j ) + p[2] * m( 2, j ) + p[3] * m( 3, j );
+    return r;
+}
+
+bool inside_polygon( const std::vector<screen_point_t> &outline, const screen_point_t &s ) {
+    bool inside = false;
+    for ( std::size_t i = 0, j = outline.size() - 1; i < outline.size(); j = i++ ) {
+        const screen_point_t &a = outline[i], &b = outline[j];
+        if ( ( a[1] > s[1] ) != ( b[1] > s[1] ) && s[0] < a[0] + ( s[1] - a[1] ) * ( b[0] - a[0] ) / ( b[1] - a[1] ) )
+            inside = !inside;
+    }
+    return inside;
+}
+
+// Selection inside the rectangle lo..hi (continuous pixel coordinates), and
+// inside outline too when it is given.
+void select_region( const std::vector<pick_target_t> &targets, const pick_view_t &view,
+                    const screen_point_t &lo, const screen_point_t &hi,
+                    const std::vector<screen_point_t> *outline, bool want_faces, selection_t &selection ) {
+    selection.objects.clear();
+    selection.faces.clear();
+    if ( view.width <= 0 || view.height <= 0 || hi[0] < lo[0] || hi[1] < lo[1] )
+        return;
+
+    std::vector<mesh_bvh_t::plane_t> planes = region_planes( view, lo, hi );
+    mat4_t wld2cam;
+    if ( !view.cam2wld.invert( wld2cam ) )
+        return;
+    double tan_half = std::tan( view.fovy * 3.14159265358979323846 / 360 );
+    double aspect = view.width / double( view.height );
+
+    std::vector<int> candidates;
+    for ( auto &target : targets ) {
+        if ( !target.bvh || target.bvh->nodes.empty() )
+            continue;
+
+        double3 center;
+        double radius;
+        bounding_sphere( target, center, radius );
+        bool outside = false;
+        for ( auto &p : planes ) {
+            double n = std::sqrt( p[0] * p[0] + p[1] * p[1] + p[2] * p[2] );
+            if ( p[0] * center[0] + p[1] * center[1] + p[2] * center[2] + p[3] < -radius * n ) {
+                outside = true;
+                break;
+            }
+        }
+        if ( outside )
+            continue;
+
+        // Faces whose bounds reach into the region, then the exact test on
+        // their corners and centers in screen space.
+        std::vector<mesh_bvh_t::plane_t> local( planes.size() );
+        for ( std::size_t i = 0; i < planes.size(); ++i )
+            local[i] = pull_back( planes[i], target.world );
+        candidates.clear();
+        target.bvh->query_frustum( local, candidates );
+
+        const wavefront_obj_t &mesh = target.bvh->mesh;
+        mat4_t model_view = wld2cam * target.world;
+        std::vector<int> hits;
+        for ( int f : candidates ) {
+            const wavefront_obj_t::face_t &face = mesh.faces[f];
+            double3 sum{ 0, 0, 0 };
+            std::size_t corners = 0;
+            bool selected = false;
+            for ( std::size_t i = 0; i <= face.count && !selected; ++i ) {
+                double3 p;
+                if ( i < face.count ) {
+                    int v = mesh.vertex_indices[face.idx_begin + i];
+                    if ( v < 0 || std::size_t( v ) >= mesh.vertices.size() )
+                        continue;
+                    p = mesh.vertices[v];
+                    for ( int k = 0; k < 3; ++k )
+                        sum[k] += p[k];
+                    ++corners;
+                } else {
+                    if ( corners == 0 )
+                        break;
+                    for ( int k = 0; k < 3; ++k )
+                        p[k] = sum[k] / corners;        // the center, after every corner
+                }
+                double3 e = model_view.transform_point( p );
+                if ( -e[2] < view.z_near || -e[2] > view.z_far )
+                    continue;
+                screen_point_t s{ ( e[0] / ( -e[2] * tan_half * aspect ) + 1 ) * view.width / 2 - 0.5,
+                                  ( e[1] / ( -e[2] * tan_half ) + 1 ) * view.height / 2 - 0.5 };
+                selected = s[0] >= lo[0] && s[0] <= hi[0] && s[1] >= lo[1] && s[1] <= hi[1]
+                           && ( !outline || inside_polygon( *outline, s ) );
+            }
+            if ( selected ) {
+                hits.push_back( f );
+                if ( !want_faces )
+                    break;
+            }
+        }
+        if ( hits.empty() )
+            continue;
+        selection.objects.push_back( target.object );
+        if ( want_faces )
+            selection.faces.push_back( std::move( hits ) );
+    }
+}
+
+}
+
+void pixel_ray( const mat4_t &cam2wld, int x, int y, int width, int height, double fovy,
+                double3 &origin, double3 &dir ) {
+    double tan_half = std::tan( fovy * 3.14159265358979323846 / 360 );
+    double aspect = width / double( height );
+    double3 eye_dir{ ( 2 * ( x + 0.5 ) / width - 1 ) * tan_half * aspect,
+                     ( 2 * ( y + 0.5 ) / height - 1 ) * tan_half,
+                     -1 };
+    origin = double3{ cam2wld.m[12], cam2wld.m[13], cam2wld.m[14] };
+    dir = cam2wld.transform_vector( eye_dir );
+}
+
+bool pick( const std::vector<pick_target_t> &targets, const double3 &origin, const double3 &dir, pick_hit_t &hit ) {
+    hit.t = std::numeric_limits<double>::infinity();
+    hit.object = -1;
+    hit.face = -1;
+
+    for ( auto &target : targets ) {
+        if ( !target.bvh || target.bvh->nodes.empty() )
+            continue;
+
+        double3 center;
+        double radius;
+        bounding_sphere( target, center, radius );
+        if ( !ray_meets_sphere( origin, dir, center, radius, hit.t ) )
+            continue;
+
+        // In model space the ray keeps the same parameter t, because the
+        // direction is transformed without being renormalized.
+        mat4_t wld2obj;
+        if ( !target.world.invert( wld2obj ) )
+            continue;
+        mesh_bvh_t::hit_t h;
+        if ( target.bvh->intersect_ray( wld2obj.transform_point( origin ), wld2obj.transform_vector( dir ), h, hit.t ) ) {
+            hit.object = target.object;
+            hit.face = h.face;
+            hit.t = h.t;
+        }
+    }
+
+    if ( hit.object < 0 )
+        return false;
+    for ( int i = 0; i < 3; ++i )
+        hit.point[i] = origin[i] + hit.t * dir[i];
+    return true;
+}
+
+std::vector<mesh_bvh_t::plane_t> region_planes( const pick_view_t &view, const screen_point_t &lo, const screen_point_t &hi ) {
+    double tan_half = std::tan( view.fovy * 3.14159265358979323846 / 360 );
+    double aspect = view.width / double( view.height );
+    // slopes x / -z and y / -z of the region's edges in camera space
+    double left = ( 2 * ( lo[0] + 0.5 ) / view.width - 1 ) * tan_half * aspect;
+    double right = ( 2 * ( hi[0] + 0.5 ) / view.width - 1 ) * tan_half * aspect;
+    double bottom = ( 2 * ( lo[1] + 0.5 ) / view.height - 1 ) * tan_half;
+    double top = ( 2 * ( hi[1] + 0.5 ) / view.height - 1 ) * tan_half;
+    std::vector<mesh_bvh_t::plane_t> planes{
+        { 1, 0, left, 0 },
+        { -1, 0, -right, 0 },
+        { 0, 1, bottom, 0 },
+        { 0, -1, -top, 0 },
+        { 0, 0, -1, -view.z_near },
+        { 0, 0, 1, view.z_far },
+    };
+
+    mat4_t wld2cam;
+    if ( !view.cam2wld.invert( wld2cam ) )
+        return std::vector<mesh_bvh_t::plane_t>();
+    for ( auto &p : planes )
+        p = pull_back( p, wld2cam );
+    return planes;
+}
+
+bool box_in_planes( const std::vector<mesh_bvh_t::plane_t> &planes, const mat4_t &world,
+                    const double3 &lo, const double3 &hi ) {
+    double3 center{ 0.5 * ( lo[0] + hi[0] ), 0.5 * ( lo[1] + hi[1] ), 0.5 * ( lo[2] + hi[2] ) };
+    center = world.transform_point( center );
+    double3 axes[3] = {                                 // half edges of the box in world space
+        world.transform_vector( double3{ 0.5 * ( hi[0] - lo[0] ), 0, 0 } ),
+        world.transform_vector( double3{ 0, 0.5 * ( hi[1] - lo[1] ), 0 } ),
+        world.transform_vector( double3{ 0, 0, 0.5 * ( hi[2] - lo[2] ) } ),
+    };
+    for ( auto &p : planes ) {
+        double3 n{ p[0], p[1], p[2] };
+        double extent = std::fabs( dot( n, axes[0] ) ) + std::fabs( dot( n, axes[1] ) ) + std::fabs( dot( n, axes[2] ) );
+        if ( dot( n, center ) + p[3] + extent < 0 )
+            return false;
+    }
+    return true;
+}
+
+void select_box( const std::vector<pick_target_t> &targets, const pick_view_t &view,
+                 const screen_point_t &a, const screen_point_t &b, bool faces, selection_t &selection ) {
+    screen_point_t lo{ std::min( a[0], b[0] ) - 0.5, std::min( a[1], b[1] ) - 0.5 };
+    screen_point_t hi{ std::max( a[0], b[0] ) + 0.5, std::max( a[1], b[1] ) + 0.5 };
+    select_region( targets, view, lo, hi, nullptr, faces, selection );
+}
+
+void select_lasso( const std::vector<pick_target_t> &targets, const pick_view_t &view,
+                   const std::vector<screen_point_t> &outline, bool faces, selection_t &selection ) {
+    if ( outline.size() < 3 ) {
+        selection.objects.clear();
+        selection.faces.clear();
+        return;
+    }
+    screen_point_t lo = outline[0], hi = outline[0];
+    for ( auto &s : outline ) {
+        for ( int k = 0; k < 2; ++k ) {
+            lo[k] = std::min( lo[k], s[k] );
+            hi[k] = std::max( hi[k], s[k] );
+        }
+    }
+    select_region( targets, view, lo, hi, &outline, faces, selection );
+}
@@ -0,0 +1,74 @@
+#ifndef _SCENE_PICK_H_
+#define _SCENE_PICK_H_
+
+#include <vector>
+#include <array>
+#include "mat4.h"
+#include "mesh_bvh.h"
+
+// Picking by casting a ray on the CPU: no extra frame is rendered and nothing
+// is read back from GL. Each object is first tested against a world-space
+// bounding sphere, and only objects the ray can hit have their face
+// hierarchy searched, so a click costs roughly log(faces) per object hit.
+// Box and lasso selection work the same way with the sub-frustum of the
+// screen region in place of the ray.
+struct pick_target_t {
+	int object;                 // id reported for hits on this object
+	const mesh_bvh_t *bvh;      // faces of the object in model space
+	mat4_t world;               // model to world
+};
+
+struct pick_hit_t {
+	int object;
+	int face;                   // index into the object's mesh faces
+	double t;                   // ray parameter of the hit
+	mat4_t::double3 point;      // world-space hit point
+};
+
+// Ray in world space through the center of pixel (x, y) of a perspective
+// view with vertical field of view fovy (degrees). y counts up from the
+// bottom of the viewport, as in glReadPixels. dir is not normalized.
+void pixel_ray( const mat4_t &cam2wld, int x, int y, int width, int height, double fovy,
+                mat4_t::double3 &origin, mat4_t::double3 &dir );
+
+// Nearest hit of origin + t * dir (t >= 0) among targets.
+bool pick( const std::vector<pick_target_t> &targets, const mat4_t::double3 &origin,
+           const mat4_t::double3 &dir, pick_hit_t &hit );
+
+using screen_point_t = std::array<double, 2>;   // pixel coordinates, y up from the bottom
+
+// A perspective view as set up by gluPerspective( fovy, width / height, z_near, z_far ).
+struct pick_view_t {
+	mat4_t cam2wld;
+	int width, height;
+	double fovy;                // degrees
+	double z_near, z_far;
+};
+
+struct selection_t {
+	std::vector<int> objects;               // ids of the selected targets, in target order
+	std::vector<std::vector<int>> faces;    // faces[k] are the selected faces of objects[k], if asked for
+};
+
+// World-space planes (inside when a*x + b*y + c*z + d >= 0) of the part of
+// the view frustum that projects into lo..hi. lo and hi are continuous pixel
+// coordinates: pixel (x, y) covers x - 0.5 .. x + 0.5.
+std::vector<mesh_bvh_t::plane_t> region_planes( const pick_view_t &view, const screen_point_t &lo, const screen_point_t &hi );
+
+// False when the box lo..hi, given in model space and placed in the world by
+// world, is entirely outside one of planes. Boxes near a corner of the
+// region can pass without being inside it, so this suits culling only.
+bool box_in_planes( const std::vector<mesh_bvh_t::plane_t> &planes, const mat4_t &world,
+                    const mat4_t::double3 &lo, const mat4_t::double3 &hi );
+
+// Select the targets with a face having a corner or its center inside the
+// pixel rectangle spanned by corners a and b (both inclusive). With faces,
+// every such face is listed, otherwise each object stops at its first one.
+void select_box( const std::vector<pick_target_t> &targets, const pick_view_t &view,
+                 const screen_point_t &a, const screen_point_t &b, bool faces, selection_t &selection );
+
+// As select_box, inside the closed polygon outline (even-odd rule).
+void select_lasso( const std::vector<pick_target_t> &targets, const pick_view_t &view,
+                   const std::vector<screen_point_t> &outline, bool faces, selection_t &selection );
+
+#endif // _SCENE_PICK_H_
@@ -0,0 +1,306 @@
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include "parallel.h"
+#include "soft_raster.h"
+
+namespace {
+
+// Screen-space vertex; r, g, b, u, v are divided by w for perspective-correct interpolation.
+struct screen_vertex_t {
+    double x, y, z, inv_w;
+    float r, g, b, u, v;
+};
+
+struct triangle_t {
+    screen_vertex_t v[3];
+    double area;            // twice the signed area, made positive
+    int min_x, max_x, min_y, max_y;
+    bool top_left[3];       // edge i runs from v[(i + 1) % 3] to v[(i + 2) % 3]
+};
+
+const int band_rows = 16;
+
+template<class V>
+V lerp( const V &a, const V &b, double t ) {
+    V r;
+    r.x = a.x + t * ( b.x - a.x );
+    r.y = a.y + t * ( b.y - a.y );
+    r.z = a.z + t * ( b.z - a.z );
+    r.w = a.w + t * ( b.w - a.w );
+    r.r = float( a.r + t * ( b.r - a.r ) );
+    r.g = float( a.g + t * ( b.g - a.g ) );
+    r.b = float( a.b + t * ( b.b - a.b ) );
+    r.u = float( a.u + t * ( b.u - a.u ) );
+    r.v = float( a.v + t * ( b.v - a.v ) );
+    return r;
+}
+
+// Positive when p lies to the left of a -> b. The endpoints are put in a
+// fixed order first, so the two triangles sharing an edge get exactly
+// opposite values and no pixel center on it is lost to rounding.
+double edge( const screen_vertex_t &a, const screen_vertex_t &b, double px, double py ) {
+    if ( a.y < b.y || ( a.y == b.y && a.x < b.x ) )
+        return ( b.x - a.x ) * ( py - a.y ) - ( b.y - a.y ) * ( px - a.x );
+    return -( ( a.x - b.x ) * ( py - b.y ) - ( a.y - b.y ) * ( px - b.x ) );
+}
+
+// Counter-clockwise with y up: a pixel center exactly on a shared edge
+// belongs to the triangle for which that edge is a top or a left edge.
+bool is_top_left( const screen_vertex_t &a, const screen_vertex_t &b ) {
+    return ( a.y == b.y && b.x < a.x ) || b.y < a.y;
+}
+
+float clamp01( double x ) {
+    return float( std::min( 1.0, std::max( 0.0, x ) ) );
+}
+
+std::uint8_t to_byte( float x ) {
+    return std::uint8_t( std::lround( clamp01( x ) * 255 ) );
+}
+
+}
+
+soft_raster_t::soft_raster_t( int width, int height )
+    : width( std::max( 1, width ) ), height( std::max( 1, height ) ),
+      color( std::size_t( this->width ) * this->height * 3 ), depth( std::size_t( this->width ) * this->height, 1.0f ),
+      pool( std::make_shared<thread_pool_t>( std::max( 2u, std::thread::hardware_concurrency() ) - 1 ) ) {}
+
+void soft_raster_t::perspective( double fovy, double aspect, double z_near, double z_far ) {
+    double f = 1 / std::tan( fovy * 3.14159265358979323846 / 360 );
+    projection = mat4_t( f / aspect, 0, 0, 0,
+                         0, f, 0, 0,
+                         0, 0, ( z_far + z_near ) / ( z_near - z_far ), -1,
+                         0, 0, 2 * z_far * z_near / ( z_near - z_far ), 0 );
+}
+
+void soft_raster_t::clear( float r, float g, float b ) {
+    const std::uint8_t rgb[3] = { to_byte( r ), to_byte( g ), to_byte( b ) };
+    for ( std::size_t i = 0; i < color.size(); i += 3 )
+        std::copy( rgb, rgb + 3, color.begin() + i );
+    std::fill( depth.begin(), depth.end(), 1.0f );
+}
+
+void soft_raster_t::draw_mesh( const mesh_buffer_t &mesh, const mat4_t &model_view, const color_t &c, bool lit ) {
+    mat4_t inverse, normal_matrix;      // normals go through the inverse transpose
+    if ( !model_view.invert( inverse ) )
+        return;
+    normal_matrix = inverse.transpose();
+    mat4_t model_view_projection = projection * model_view;
+
+    std::vector<vertex_t> vertices( mesh.vertices.size() );
+    parallel_for( *pool, 0, vertices.size(), [&]( std::size_t i ) {
+        const mesh_buffer_t::vertex_t &in = mesh.vertices[i];
+        const double p[4] = { in.position[0], in.position[1], in.position[2], 1 };
+        const mat4_t &m = model_view_projection;
+        vertex_t &out = vertices[i];
+        out.x = m( 0, 0 ) * p[0] + m( 0, 1 ) * p[1] + m( 0, 2 ) * p[2] + m( 0, 3 );
+        out.y = m( 1, 0 ) * p[0] + m( 1, 1 ) * p[1] + m( 1, 2 ) * p[2] + m( 1, 3 );
+        out.z = m( 2, 0 ) * p[0] + m( 2, 1 ) * p[1] + m( 2, 2 ) * p[2] + m( 2, 3 );
+        out.w = m( 3, 0 ) * p[0] + m( 3, 1 ) * p[1] + m( 3, 2 ) * p[2] + m( 3, 3 );
+
+        double intensity = 1;
+        if ( lit ) {
+            double3 n = normal_matrix.transform_vector( double3{ in.normal[0], in.normal[1], in.normal[2] } );
+            double l = std::sqrt( mat4_t::dot( n, n ) );
+            double diffuse = l > 0 ? std::max( 0.0, mat4_t::dot( n, light.direction ) / l ) : 0;
+            intensity = light.ambient + light.diffuse * diffuse;
+        }
+        out.r = clamp01( c[0] * intensity );
+        out.g = clamp01( c[1] * intensity );
+        out.b = clamp01( c[2] * intensity );
+        out.u = in.texcoord[0];
+        out.v = in.texcoord[1];
+    }, 4096 );
+
+    draw_triangles( vertices, mesh.indices, nullptr );
+}
+
+void soft_raster_t::draw_polygon( const std::vector<double3> &points, const std::vector<double2> &uv,
+                                  const mat4_t &model_view, const color_t &c, const texture_t *texture ) {
+    if ( points.size() < 3 )
+        return;
+    mat4_t model_view_projection = projection * model_view;
+    std::vector<vertex_t> vertices( points.size() );
+    std::vector<std::uint32_t> indices;
+    for ( std::size_t i = 0; i < points.size(); ++i ) {
+        const mat4_t &m = model_view_projection;
+        const double3 &p = points[i];
+        vertex_t &out = vertices[i];
+        out.x = m( 0, 0 ) * p[0] + m( 0, 1 ) * p[1] + m( 0, 2 ) * p[2] + m( 0, 3 );
+        out.y = m( 1, 0 ) * p[0] + m( 1, 1 ) * p[1] + m( 1, 2 ) * p[2] + m( 1, 3 );
+        out.z = m( 2, 0 ) * p[0] + m( 2, 1 ) * p[1] + m( 2, 2 ) * p[2] + m( 2, 3 );
+        out.w = m( 3, 0 ) * p[0] + m( 3, 1 ) * p[1] + m( 3, 2 ) * p[2] + m( 3, 3 );
+        out.r = c[0];
+        out.g = c[1];
+        out.b = c[2];
+        out.u = i < uv.size() ? float( uv[i][0] ) : 0.0f;
+        out.v = i < uv.size() ? float( uv[i][1] ) : 0.0f;
+        if ( i >= 2 ) {
+            indices.push_back( 0 );
+            indices.push_back( std::uint32_t( i - 1 ) );
+            indices.push_back( std::uint32_t( i ) );
+        }
+    }
+    draw_triangles( vertices, indices, texture );
+}
+
+void soft_raster_t::draw_line( const double3 &a, const double3 &b, const mat4_t &model_view, const color_t &c ) {
+    mat4_t m = projection * model_view;
+    vertex_t ends[2];
+    const double3 *points[2] = { &a, &b };
+    for ( int k = 0; k < 2; ++k ) {
+        const double3 &p = *points[k];
+        ends[k].x = m( 0, 0 ) * p[0] + m( 0, 1 ) * p[1] + m( 0, 2 ) * p[2] + m( 0, 3 );
+        ends[k].y = m( 1, 0 ) * p[0] + m( 1, 1 ) * p[1] + m( 1, 2 ) * p[2] + m( 1, 3 );
+        ends[k].z = m( 2, 0 ) * p[0] + m( 2, 1 ) * p[1] + m( 2, 2 ) * p[2] + m( 2, 3 );
+        ends[k].w = m( 3, 0 ) * p[0] + m( 3, 1 ) * p[1] + m( 3, 2 ) * p[2] + m( 3, 3 );
+        ends[k].r = ends[k].g = ends[k].b = ends[k].u = ends[k].v = 0;
+    }
+
+    // clip to the near plane, z >= -w
+    double d0 = ends[0].z + ends[0].w, d1 = ends[1].z + ends[1].w;
+    if ( d0 < 0 && d1 < 0 )
+        return;
+    if ( d0 < 0 )
+        ends[0] = lerp( ends[0], ends[1], d0 / ( d0 - d1 ) );
+    else if ( d1 < 0 )
+        ends[1] = lerp( ends[1], ends[0], d1 / ( d1 - d0 ) );
+
+    double sx[2], sy[2], sz[2];
+    for ( int k = 0; k < 2; ++k ) {
+        sx[k] = ( ends[k].x / ends[k].w + 1 ) * 0.5 * width;
+        sy[k] = ( ends[k].y / ends[k].w + 1 ) * 0.5 * height;
+        sz[k] = ( ends[k].z / ends[k].w + 1 ) * 0.5;
+    }
+    const std::uint8_t rgb[3] = { to_byte( c[0] ), to_byte( c[1] ), to_byte( c[2] ) };
+    int steps = int( std::ceil( std::max( std::fabs( sx[1] - sx[0] ), std::fabs( sy[1] - sy[0] ) ) ) );
+    steps = std::min( std::max( steps, 1 ), 4 * ( width + height ) );
+    for ( int i = 0; i <= steps; ++i ) {
+        double t = double( i ) / steps;
+        int x = int( std::floor( sx[0] + t * ( sx[1] - sx[0] ) ) );
+        int y = int( std::floor( sy[0] + t * ( sy[1] - sy[0] ) ) );
+        double z = sz[0] + t * ( sz[1] - sz[0] );
+        if ( x < 0 || y < 0 || x >= width || y >= height || z < 0 || z > 1 )
+            continue;
+        std::size_t p = std::size_t( y ) * width + x;
+        if ( z > depth[p] )
+            continue;
+        depth[p] = float( z );
+        std::copy( rgb, rgb + 3, color.begin() + 3 * p );
+    }
+}
+
+//------------------------------------------------------------------------------
+// Clip and set up every triangle in order, then fill the screen in bands of
+// rows. Each band is owned by one thread and sees the triangles in submission
+// order, so the image is the same however the bands are shared out.
+void soft_raster_t::draw_triangles( const std::vector<vertex_t> &vertices, const std::vector<std::uint32_t> &indices,
+                                    const texture_t *texture ) {
+    std::vector<triangle_t> triangles;
+    triangles.reserve( indices.size() / 3 );
+    for ( std::size_t i = 0; i + 2 < indices.size(); i += 3 ) {
+        // Sutherland-Hodgman against the near plane; a triangle becomes at most a quad.
+        vertex_t polygon[4];
+        int count = 0;
+        for ( int k = 0; k < 3; ++k ) {
+            const vertex_t &a = vertices[indices[i + k]], &b = vertices[indices[i + ( k + 1 ) % 3]];
+            double da = a.z + a.w, db = b.z + b.w;
+            if ( da >= 0 )
+                polygon[count++] = a;
+            if ( ( da >= 0 ) != ( db >= 0 ) )
+                polygon[count++] = lerp( a, b, da / ( da - db ) );
+        }
+
+        screen_vertex_t screen[4];
+        for ( int k = 0; k < count; ++k ) {
+            const vertex_t &c = polygon[k];
+            double inv_w = 1 / c.w;
+            screen[k] = screen_vertex_t{ ( c.x * inv_w + 1 ) * 0.5 * width, ( c.y * inv_w + 1 ) * 0.5 * height,
+                                         ( c.z * inv_w + 1 ) * 0.5, inv_w,
+                                         float( c.r * inv_w ), float( c.g * inv_w ), float( c.b * inv_w ),
+                                         float( c.u * inv_w ), float( c.v * inv_w ) };
+        }
+        for ( int k = 2; k < count; ++k ) {
+            triangle_t t;
+            t.v[0] = screen[0];
+            t.v[1] = screen[k - 1];
+            t.v[2] = screen[k];
+            t.area = edge( t.v[0], t.v[1], t.v[2].x, t.v[2].y );
+            if ( t.area == 0 || !std::isfinite( t.area ) )
+                continue;
+            if ( t.area < 0 ) {                 // no face culling: turn clockwise triangles around
+                std::swap( t.v[1], t.v[2] );
+                t.area = -t.area;
+            }
+            double lo_x = std::min( { t.v[0].x, t.v[1].x, t.v[2].x } ), hi_x = std::max( { t.v[0].x, t.v[1].x, t.v[2].x } );
+            double lo_y = std::min( { t.v[0].y, t.v[1].y, t.v[2].y } ), hi_y = std::max( { t.v[0].y, t.v[1].y, t.v[2].y } );
+            if ( hi_x < 0 || hi_y < 0 || lo_x > width || lo_y > height )
+                continue;
+            t.min_x = std::max( 0, int( std::floor( lo_x ) ) );
+            t.max_x = std::min( width - 1, int( std::ceil( hi_x ) ) );
+            t.min_y = std::max( 0, int( std::floor( lo_y ) ) );
+            t.max_y = std::min( height - 1, int( std::ceil( hi_y ) ) );
+            for ( int e = 0; e < 3; ++e )
+                t.top_left[e] = is_top_left( t.v[( e + 1 ) % 3], t.v[( e + 2 ) % 3] );
+            triangles.push_back( t );
+        }
+    }
+    if ( triangles.empty() )
+        return;
+
+    std::size_t bands = ( height + band_rows - 1 ) / band_rows;
+    parallel_for( *pool, 0, bands, [&]( std::size_t band ) {
+        int band_begin = int( band ) * band_rows, band_end = std::min( height, band_begin + band_rows );
+        for ( const triangle_t &t : triangles ) {
+            int y0 = std::max( t.min_y, band_begin ), y1 = std::min( t.max_y, band_end - 1 );
+            for ( int y = y0; y <= y1; ++y ) {
+                double py = y + 0.5;
+                for ( int x = t.min_x; x <= t.max_x; ++x ) {
+                    double px = x + 0.5;
+                    double w[3];
+                    bool inside = true;
+                    for ( int e = 0; e < 3 && inside; ++e ) {
+                        w[e] = edge( t.v[( e + 1 ) % 3], t.v[( e + 2 ) % 3], px, py );
+                        inside = w[e] > 0 || ( w[e] == 0 && t.top_left[e] );
+                    }
+                    if ( !inside )
+                        continue;
+
+                    double b0 = w[0] / t.area, b1 = w[1] / t.area, b2 = w[2] / t.area;
+                    double z = b0 * t.v[0].z + b1 * t.v[1].z + b2 * t.v[2].z;
+                    std::size_t p = std::size_t( y ) * width + x;
+                    if ( z < 0 || z > 1 || z > depth[p] )
+                        continue;
+                    depth[p] = float( z );
+
+                    double inv_w = b0 * t.v[0].inv_w + b1 * t.v[1].inv_w + b2 * t.v[2].inv_w;
+                    std::uint8_t *out = &color[3 * p];
+                    if ( texture ) {
+                        double u = ( b0 * t.v[0].u + b1 * t.v[1].u + b2 * t.v[2].u ) / inv_w;
+                        double v = ( b0 * t.v[0].v + b1 * t.v[1].v + b2 * t.v[2].v ) / inv_w;
+                        int tx = std::min( texture->width - 1, std::max( 0, int( std::floor( u * texture->width ) ) ) );
+                        int ty = std::min( texture->height - 1, std::max( 0, int( std::floor( v * texture->height ) ) ) );
+                        const std::uint8_t *texel = &texture->rgb[3 * ( std::size_t( ty ) * texture->width + tx )];
+                        std::copy( texel, texel + 3, out );
+                    } else {
+                        out[0] = to_byte( float( ( b0 * t.v[0].r + b1 * t.v[1].r + b2 * t.v[2].r ) / inv_w ) );
+                        out[1] = to_byte( float( ( b0 * t.v[0].g + b1 * t.v[1].g + b2 * t.v[2].g ) / inv_w ) );
+                        out[2] = to_byte( float( ( b0 * t.v[0].b + b1 * t.v[1].b + b2 * t.v[2].b ) / inv_w ) );
+                    }
+                }
+            }
+        }
+    }, 1 );
+}
+
+bool soft_raster_t::write_ppm( const std::string &path ) const {
+    FILE *file = std::fopen( path.c_str(), "wb" );
+    if ( !file )
+        return false;
+    std::fprintf( file, "P6\n%d %d\n255\n", width, height );
+    bool ok = true;
+    for ( int y = height - 1; y >= 0 && ok; --y )
+        ok = std::fwrite( &color[3 * std::size_t( y ) * width], 3, width, file ) == std::size_t( width );
+    return std::fclose( file ) == 0 && ok;
+}
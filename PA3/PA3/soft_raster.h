@@ -0,0 +1,80 @@
+#ifndef _SOFT_RASTER_H_
+#define _SOFT_RASTER_H_
+
+#include <vector>
+#include <array>
+#include <string>
+#include <cstdint>
+#include <memory>
+#include "mat4.h"
+#include "mesh_buffer.h"
+
+class thread_pool_t;
+
+// Software rasterizer for the part of fixed-function GL that SimpleScene uses:
+// a perspective projection, one directional light evaluated per vertex,
+// nearest-sampled clamped textures in replace mode, a LEQUAL depth test and
+// no face culling. It needs no GPU and no display. Triangles are clipped
+// against the near plane, and fragments beyond the far plane are dropped.
+// Each mesh is shaded on all hardware threads, then rasterized band by band,
+// one band per thread, so results do not depend on the thread count. The
+// worker threads start with the rasterizer and are shared by its copies.
+class soft_raster_t {
+public:
+	using double3 = mat4_t::double3;
+	using double2 = std::array<double, 2>;
+	using color_t = std::array<float, 4>;
+
+	struct texture_t {
+		int width, height;
+		std::vector<std::uint8_t> rgb;      // bottom row first
+	};
+	// Direction towards the light in eye space, as glLightfv( GL_POSITION )
+	// with w = 0 under an identity modelview. ambient includes the global ambient.
+	struct light_t {
+		double3 direction{ { 0.57735026918962573, 0.57735026918962573, 0.57735026918962573 } };
+		float ambient = 0.3f;
+		float diffuse = 0.9f;
+	};
+
+	int width, height;
+	std::vector<std::uint8_t> color;        // RGB, bottom row first like glReadPixels
+	std::vector<float> depth;               // 0 at the near plane, 1 at the far plane
+	mat4_t projection;
+	light_t light;
+
+	soft_raster_t( int width, int height );
+
+	// Set projection as gluPerspective does.
+	void perspective( double fovy, double aspect, double z_near, double z_far );
+
+	void clear( float r, float g, float b );
+
+	// Every triangle of mesh in one color, lit with light unless lit is false.
+	void draw_mesh( const mesh_buffer_t &mesh, const mat4_t &model_view, const color_t &color, bool lit );
+
+	// Convex polygon without lighting. With a texture, its texels replace
+	// color and uv gives the texture coordinates of each point.
+	void draw_polygon( const std::vector<double3> &points, const std::vector<double2> &uv,
+	                   const mat4_t &model_view, const color_t &color, const texture_t *texture = nullptr );
+
+	// One pixel wide, depth-tested line without lighting.
+	void draw_line( const double3 &a, const double3 &b, const mat4_t &model_view, const color_t &color );
+
+	// Binary PPM, top row first. Returns false if the file cannot be written.
+	bool write_ppm( const std::string &path ) const;
+
+private:
+	std::shared_ptr<thread_pool_t> pool;    // helps the calling thread shade and rasterize
+
+	// Clip-space vertex with its color and texture coordinates.
+	struct vertex_t {
+		double x, y, z, w;
+		float r, g, b, u, v;
+	};
+
+	void draw_triangles( const std::vector<vertex_t> &vertices, const std::vector<std::uint32_t> &indices,
+	                     const texture_t *texture );
+};
+
+#endif // _SOFT_RASTER_H_
@@ -0,0 +1,68 @@
+#include <algorithm>
+#include "parallel.h"
+#include "texture_gen.h"
+
+namespace {
+
+// Rows per parallel_for chunk; smaller levels are filled on one thread.
+const std::size_t min_rows = 32;
+
+// Box-filter src into the next smaller level.
+mip_texture_t::level_t downsample( const mip_texture_t::level_t &src ) {
+    mip_texture_t::level_t dst;
+    dst.width = std::max( 1, src.width / 2 );
+    dst.height = std::max( 1, src.height / 2 );
+    dst.rgb.resize( std::size_t( dst.width ) * dst.height * 3 );
+
+    parallel_for( 0, dst.height, [&]( std::size_t y ) {
+        // Destination texel (x, y) covers source texels [x0, x1) x [y0, y1).
+        int y0 = int( y * src.height / dst.height ), y1 = int( ( y + 1 ) * src.height / dst.height );
+        std::uint8_t *out = &dst.rgb[y * dst.width * 3];
+        for ( int x = 0; x < dst.width; x++ ) {
+            int x0 = x * src.width / dst.width, x1 = ( x + 1 ) * src.width / dst.width;
+            unsigned sum[3] = { 0, 0, 0 };
+            for ( int sy = y0; sy < y1; sy++ ) {
+                const std::uint8_t *in = &src.rgb[( std::size_t( sy ) * src.width + x0 ) * 3];
+                for ( int sx = x0; sx < x1; sx++, in += 3 ) {
+                    sum[0] += in[0];
+                    sum[1] += in[1];
+                    sum[2] += in[2];
+                }
+            }
+            unsigned count = unsigned( ( x1 - x0 ) * ( y1 - y0 ) );
+            for ( int c = 0; c < 3; c++ )
+                *out++ = std::uint8_t( ( sum[c] + count / 2 ) / count );
+        }
+    }, min_rows );
+    return dst;
+}
+
+} // namespace
+
+std::size_t mip_texture_t::memory_size() const {
+    std::size_t bytes = 0;
+    for ( const level_t &level : levels )
+        bytes += level.rgb.size();
+    return bytes;
+}
+
+mip_texture_t generate_texture( int width, int height, const texel_fn_t &fn, bool mipmaps ) {
+    mip_texture_t texture;
+    texture.levels.push_back( mip_texture_t::level_t{ width, height, std::vector<std::uint8_t>( std::size_t( width ) * height * 3 ) } );
+
+    mip_texture_t::level_t &base = texture.levels[0];
+    parallel_for( 0, height, [&]( std::size_t y ) {
+        std::uint8_t *out = &base.rgb[y * width * 3];
+        for ( int x = 0; x < width; x++, out += 3 )
+            fn( x, int( y ), out );
+    }, min_rows );
+
+    while ( mipmaps && ( texture.levels.back().width > 1 || texture.levels.back().height > 1 ) )
+        texture.levels.push_back( downsample( texture.levels.back() ) );
+    return texture;
+}
+
+std::future<mip_texture_t> generate_texture_async( int width, int height, texel_fn_t fn, bool mipmaps ) {
+    static thread_pool_t pool( 1 );     // one job at a time; each spreads its rows over every core itself
+    return pool.submit( [=]() { return generate_texture( width, height, fn, mipmaps ); } );
+}
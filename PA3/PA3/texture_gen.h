@@ -0,0 +1,36 @@
+#ifndef _TEXTURE_GEN_H_
+#define _TEXTURE_GEN_H_
+
+#include <vector>
+#include <future>
+#include <cstdint>
+#include <functional>
+
+// RGB texture with its mip chain: levels[0] is the full image and each next
+// level halves both sides, rounding down, until 1x1. Rows are tightly packed
+// and bottom row first, ready for glTexImage2D with GL_UNPACK_ALIGNMENT 1.
+struct mip_texture_t {
+	struct level_t {
+		int width, height;
+		std::vector<std::uint8_t> rgb;
+	};
+	std::vector<level_t> levels;
+
+	std::size_t memory_size() const;
+};
+
+// Color of texel (x, y) of level 0, written to rgb[0..2]. Called from
+// several threads at once, so it must not write shared state.
+using texel_fn_t = std::function<void( int x, int y, std::uint8_t *rgb )>;
+
+// Fill a width x height level 0 with fn, rows split across all hardware
+// threads, then build the mip chain unless mipmaps is false. Each mip texel
+// is the box-filtered average of the texels it covers in the level above,
+// so sizes need not be powers of two.
+mip_texture_t generate_texture( int width, int height, const texel_fn_t &fn, bool mipmaps = true );
+
+// generate_texture() on a background thread, so a caller such as the render
+// loop can keep going and swap the texture in once the future is ready.
+std::future<mip_texture_t> generate_texture_async( int width, int height, texel_fn_t fn, bool mipmaps = true );
+
+#endif // _TEXTURE_GEN_H_
@@ -6,8 +6,11 @@
 #include <cmath>
 #include <cstring>
 #include <stdexcept>
+#include <chrono>
+#include <cstdlib>
 #include <GL/glut.h>
 #include "wavefront_obj.h"
+#include "parallel.h"
 
 namespace {
 
@@ -15,7 +18,7 @@ using double2 = wavefront_obj_t::double2;
 using double3 = wavefront_obj_t::double3;
 
 // normalize double2 or double3 into unit vector if it is nonzero.
-template<class T, int S>
+template<class T, std::size_t S>
 std::array<T, S> normalize( std::array<T, S> u ) {
     T l = T( 0 );
     for ( std::size_t i = 0; i < S; ++i )
@@ -48,10 +51,134 @@ double3 compute_face_normal( double3 &v0, double3 &v1, double3 &v2 ) {
     return normalize( n );
 }
 
+double dot( const double3 &a, const double3 &b ) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+//Polygon normal by Newell's method. Its length is twice the polygon area.
+double3 compute_newell_normal( const std::vector<double3> &vertices, const int *idx, std::size_t count ) {
+    double3 n{ 0, 0, 0 };
+    for ( std::size_t i = 0; i < count; ++i ) {
+        const double3 &p = vertices[idx[i]];
+        const double3 &q = vertices[idx[( i + 1 ) % count]];
+        n[0] += ( p[1] - q[1] ) * ( p[2] + q[2] );
+        n[1] += ( p[2] - q[2] ) * ( p[0] + q[0] );
+        n[2] += ( p[0] - q[0] ) * ( p[1] + q[1] );
+    }
+    return n;
+}
+
+//Interior angle of a polygon at vertex v, between its neighbours prev and next.
+double compute_corner_angle( const double3 &prev, const double3 &v, const double3 &next ) {
+    double3 a, b;
+    for ( int i = 0; i < 3; ++i ) {
+        a[i] = prev[i] - v[i];
+        b[i] = next[i] - v[i];
+    }
+    double c = dot( normalize( a ), normalize( b ) );
+    return std::acos( std::max( -1.0, std::min( 1.0, c ) ) );
+}
+
+//Milliseconds since construction or the previous lap().
+class stopwatch_t {
+public:
+    stopwatch_t() : last( std::chrono::steady_clock::now() ) {}
+
+    double lap() {
+        auto now = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>( now - last ).count();
+        last = now;
+        return ms;
+    }
+
+private:
+    std::chrono::steady_clock::time_point last;
+};
+
+//Cursor over one line of an OBJ file. Every read stops at the end of the
+//line, so a line with missing values never consumes the next one.
+struct line_t {
+    const char *p, *end;
+
+    void skip_blanks() {
+        while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\r' ) )
+            ++p;
+    }
+
+    bool word( std::string &w ) {
+        skip_blanks();
+        const char *begin = p;
+        while ( p < end && *p != ' ' && *p != '\t' && *p != '\r' )
+            ++p;
+        w.assign( begin, p );
+        return p != begin;
+    }
+
+    bool number( double &x ) {
+        skip_blanks();
+        if ( p == end )
+            return false;
+        char *next;
+        x = std::strtod( p, &next );
+        if ( next == p || next > end )
+            return false;
+        p = next;
+        return true;
+    }
+
+    bool index( long &i ) {
+        if ( p == end || !( *p == '-' || *p == '+' || ( *p >= '0' && *p <= '9' ) ) )
+            return false;
+        char *next;
+        i = std::strtol( p, &next, 10 );
+        p = next;
+        return true;
+    }
+
+    // One v, v/t, v//n or v/t/n item of an f line; missing indices are 0.
+    bool corner( long &v, long &t, long &n ) {
+        skip_blanks();
+        v = t = n = 0;
+        if ( !index( v ) )
+            return false;
+        if ( p < end && *p == '/' ) {
+            ++p;
+            index( t );
+            if ( p < end && *p == '/' ) {
+                ++p;
+                index( n );
+            }
+        }
+        // skip whatever is left of a malformed item
+        while ( p < end && *p != ' ' && *p != '\t' && *p != '\r' )
+            ++p;
+        return true;
+    }
+};
+
+//Index of the material called name. An unknown name is -1, or a new material
+//with default colors if create is set.
+int find_material( std::vector<wavefront_obj_t::material_t> &materials, const std::string &name, bool create ) {
+    for ( std::size_t i = 0; i < materials.size(); ++i ) {
+        if ( materials[i].name == name )
+            return int( i );
+    }
+    if ( !create )
+        return -1;
+    materials.push_back( wavefront_obj_t::material_t() );
+    materials.back().name = name;
+    return int( materials.size() - 1 );
+}
+
 //Given a list (represented by a pair of iterators) of vertices, compute axis-aligned bounding box (AABB).
 template<class IterT>
 std::pair<double3, double3> compute_aabb( IterT vert_begin, IterT vert_end ) {
     std::pair<double3, double3> aabb{ double3{0, 0, 0}, double3{0, 0, 0} };
+    if ( vert_begin == vert_end )
+        return aabb;
+
+    // start from the first vertex, not the origin, or the box would always contain it
+    aabb.first = aabb.second = *vert_begin;
 
     for( ; vert_begin != vert_end; ++vert_begin ) {
         auto &vert = *vert_begin;
@@ -70,112 +197,371 @@ std::pair<double3, double3> compute_aabb( IterT vert_begin, IterT vert_end ) {
 wavefront_obj_t::wavefront_obj_t(const char *path ) {
     is_flat = true;
 
-    std::string line;
-    std::istringstream line_stream, item_stream;
-
-    std::ifstream file( path );
+    stopwatch_t watch;
+    std::ifstream file( path, std::ios::binary | std::ios::ate );
     if ( !file )
         throw std::runtime_error( "Cannot open file." );
+    std::string text( std::size_t( file.tellg() ), '\0' );
+    file.seekg( 0 );
+    if ( !file.read( &text[0], text.size() ) )
+        throw std::runtime_error( "Cannot read file." );
+    stats.io_ms = watch.lap();
 
-    while ( std::getline( file, line ) ) {
-        // strip off comments and blank lines
-        if ( line[0] == '#' || line.size() == 0 )
-            continue;
+    // mtllib and map_Kd paths are relative to the directory of the OBJ file
+    std::string directory( path );
+    std::size_t slash = directory.find_last_of( "/\\" );
+    directory = ( slash == std::string::npos ) ? std::string() : directory.substr( 0, slash + 1 );
+    int material = -1;
 
-        // parse line
-        line_stream.clear();
-        line_stream.str( line );
+    const char *p = text.c_str(), *end = p + text.size();
+    while ( p < end ) {
+        const char *eol = static_cast<const char *>( std::memchr( p, '\n', end - p ) );
+        line_t line{ p, eol ? eol : end };
+        p = eol ? eol + 1 : end;
+        ++stats.lines;
 
+        // strip off comments and blank lines
         std::string mode;
-        line_stream >> mode;
+        if ( !line.word( mode ) || mode[0] == '#' )
+            continue;
+
         if ( mode == "v" ) {
-            double x, y, z;
-            line_stream >> x >> y >> z;
-            vertices.push_back( double3{ x, y, z } );
+            double3 v{ 0, 0, 0 };
+            line.number( v[0] ), line.number( v[1] ), line.number( v[2] );
+            vertices.push_back( v );
         } else if ( mode == "vn" ) {
-            double x, y, z;
-            line_stream >> x >> y >> z;
-            normals.push_back( normalize( double3{ x, y, z } ) );
+            double3 n{ 0, 0, 0 };
+            line.number( n[0] ), line.number( n[1] ), line.number( n[2] );
+            normals.push_back( n );
         } else if ( mode == "vt" ) {
-            double u, v;
-            line_stream >> u >> v;
-            texcoords.push_back( double2{u, v} );
+            double2 t{ 0, 0 };
+            line.number( t[0] ), line.number( t[1] );
+            texcoords.push_back( t );
         } else if ( mode == "f" ) {
             face_t face;
             std::memset( &face, 0, sizeof( face_t ) );
             face.idx_begin = vertex_indices.size();
+            face.material = material;
 
-            std::string item;
-            while ( line_stream >> item ) {
-                item_stream.clear();
-                item_stream.str( item );
-
-                int v = 0, t = 0, n = 0;
-				do {
-					item_stream >> v;
-					char c;
-					if (!(bool(item_stream >> c) && c == '/'))
-						continue;
-					if (!(item_stream >> t))
-						item_stream.clear();
-					if (!(bool(item_stream >> c) && c == '/'))
-						continue;
-					if (!(item_stream >> n))
-						item_stream.clear();
-				} while (false);
-
-                vertex_indices.push_back( v - 1 );
-                texcoord_indices.push_back( t - 1 );
-                normal_indices.push_back( n - 1 );
+            long v, t, n;
+            while ( line.corner( v, t, n ) ) {
+                // negative indices count back from the latest element
+                vertex_indices.push_back( int( v < 0 ? long( vertices.size() ) + v : v - 1 ) );
+                texcoord_indices.push_back( int( t < 0 ? long( texcoords.size() ) + t : t - 1 ) );
+                normal_indices.push_back( int( n < 0 ? long( normals.size() ) + n : n - 1 ) );
                 ++face.count;
 
                 if ( n )
                     is_flat = false;
             }
-            if ( face.count > 2 ) {
-                face.normal = compute_face_normal(
-                                  vertices[vertex_indices[face.idx_begin]],
-                                  vertices[vertex_indices[face.idx_begin + 1]],
-                                  vertices[vertex_indices[face.idx_begin + 2]]
-                              );
-            }
-
             faces.push_back( face );
         } else if ( mode == "g" ) { // group
         } else if ( mode == "s" ) { // smoothing group
-        } else if ( mode == "u" ) { // material line
+        } else if ( mode == "mtllib" ) { // material library
+            std::string name;
+            while ( line.word( name ) ) {
+                material_libraries.push_back( directory + name );
+                load_materials( material_libraries.back() );
+            }
+        } else if ( mode == "usemtl" ) { // material line
+            std::string name;
+            line.word( name );
+            material = find_material( materials, name, false );
         } else {
-            std::cerr << "Warning: unsupported Wavefront OBJ option: " << mode << "\n";
+            ++stats.skipped[mode];
         }
     }
+    stats.tokenize_ms = watch.lap();
 
+    compute_face_normals();
+    sort_faces_by_material();
+    stats.faces_ms = watch.lap();
+
+    for ( auto &n : normals )
+        n = normalize( n );
+    stats.normals_ms = watch.lap();
+
+    compute_bounds();
+    stats.bounds_ms = watch.lap();
+}
+
+void wavefront_obj_t::print_load_stats( std::ostream &out, const char *name ) const {
+    out << name << ": " << stats.lines << " lines, " << vertices.size() << " vertices, "
+        << normals.size() << " normals, " << texcoords.size() << " texcoords, "
+        << faces.size() << " faces, " << vertex_indices.size() << " corners, "
+        << materials.size() << " materials\n";
+    out << "  io " << stats.io_ms << " ms, tokenize " << stats.tokenize_ms << " ms, faces "
+        << stats.faces_ms << " ms, normals " << stats.normals_ms << " ms, aabb " << stats.bounds_ms << " ms\n";
+    if ( !stats.skipped.empty() ) {
+        out << "  skipped unsupported lines:";
+        for ( auto &skipped : stats.skipped )
+            out << " " << skipped.first << " x" << skipped.second;
+        out << "\n";
+    }
+}
+
+//------------------------------------------------------------------------------
+// Read newmtl blocks from a .mtl file. A missing library is only a warning:
+// faces that use its materials keep whatever GL material is current.
+void wavefront_obj_t::load_materials( const std::string &path ) {
+    std::ifstream file( path );
+    if ( !file ) {
+        std::cerr << "Warning: cannot open material library " << path << "\n";
+        return;
+    }
+
+    std::string line, key;
+    std::istringstream line_stream;
+    material_t *m = nullptr;
+    while ( std::getline( file, line ) ) {
+        line_stream.clear();
+        line_stream.str( line );
+        if ( !( line_stream >> key ) || key[0] == '#' )
+            continue;
+
+        if ( key == "newmtl" ) {
+            std::string name;
+            line_stream >> name;
+            m = &materials[find_material( materials, name, true )];
+        } else if ( !m ) {
+            continue;
+        } else if ( key == "Ka" ) {
+            line_stream >> m->ambient[0] >> m->ambient[1] >> m->ambient[2];
+        } else if ( key == "Kd" ) {
+            line_stream >> m->diffuse[0] >> m->diffuse[1] >> m->diffuse[2];
+        } else if ( key == "Ks" ) {
+            line_stream >> m->specular[0] >> m->specular[1] >> m->specular[2];
+        } else if ( key == "Ns" ) {
+            line_stream >> m->shininess;
+            m->shininess = std::max( 0.0f, std::min( 128.0f, m->shininess ) );
+        } else if ( key == "d" || key == "Tr" ) {
+            float alpha = 1;
+            line_stream >> alpha;
+            if ( key == "Tr" )
+                alpha = 1 - alpha;
+            m->ambient[3] = m->diffuse[3] = m->specular[3] = alpha;
+        } else if ( key == "map_Kd" ) {
+            line_stream >> m->diffuse_map;
+        }
+    }
+}
+
+std::size_t wavefront_obj_t::memory_size() const {
+    std::size_t bytes = sizeof( *this );
+    bytes += vertices.capacity() * sizeof( vertices[0] ) + normals.capacity() * sizeof( normals[0] );
+    bytes += texcoords.capacity() * sizeof( texcoords[0] ) + faces.capacity() * sizeof( faces[0] );
+    bytes += ( vertex_indices.capacity() + normal_indices.capacity() + texcoord_indices.capacity() ) * sizeof( int );
+    bytes += materials.capacity() * sizeof( material_t ) + batches.capacity() * sizeof( batch_t );
+    return bytes;
+}
+
+void wavefront_obj_t::sort_faces_by_material() {
+    std::stable_sort( faces.begin(), faces.end(), []( const face_t &a, const face_t &b ) {
+        return a.material < b.material;
+    } );
+
+    batches.clear();
+    for ( std::size_t f = 0; f < faces.size(); ++f ) {
+        if ( batches.empty() || batches.back().material != faces[f].material )
+            batches.push_back( batch_t{ faces[f].material, f, 0 } );
+        ++batches.back().face_count;
+    }
+}
+
+void wavefront_obj_t::compute_bounds() {
     aabb = compute_aabb( std::begin( vertices ), std::end( vertices ) );
 }
 
+void wavefront_obj_t::compute_face_normals() {
+    auto valid = [this]( int v ) {
+        return v >= 0 && std::size_t( v ) < vertices.size();
+    };
+    for ( auto &face : faces ) {
+        face.normal = double3{ 0, 0, 0 };
+        if ( face.count > 2 && valid( vertex_indices[face.idx_begin] ) &&
+                valid( vertex_indices[face.idx_begin + 1] ) && valid( vertex_indices[face.idx_begin + 2] ) ) {
+            face.normal = compute_face_normal(
+                              vertices[vertex_indices[face.idx_begin]],
+                              vertices[vertex_indices[face.idx_begin + 1]],
+                              vertices[vertex_indices[face.idx_begin + 2]]
+                          );
+        }
+    }
+}
+
 
 //------------------------------------------------------------------------------
 // Draw object which is read from file
 void wavefront_obj_t::draw() {
-    for ( std::size_t f = 0; f < faces.size(); f++ ) {
+    if ( batches.empty() ) {
+        draw_faces( 0, faces.size() );
+        return;
+    }
+    for ( auto &batch : batches ) {
+        if ( batch.material >= 0 ) {
+            const material_t &m = materials[batch.material];
+            glMaterialfv( GL_FRONT_AND_BACK, GL_AMBIENT, m.ambient.data() );
+            glMaterialfv( GL_FRONT_AND_BACK, GL_DIFFUSE, m.diffuse.data() );
+            glMaterialfv( GL_FRONT_AND_BACK, GL_SPECULAR, m.specular.data() );
+            glMaterialf( GL_FRONT_AND_BACK, GL_SHININESS, m.shininess );
+        }
+        draw_faces( batch.face_begin, batch.face_count );
+    }
+}
+
+// All faces of a run go into one GL_TRIANGLES block, each polygon as a fan,
+// instead of a glBegin/glEnd pair per face.
+void wavefront_obj_t::draw_faces( std::size_t begin, std::size_t count ) {
+    glBegin( GL_TRIANGLES );
+    for ( std::size_t f = begin; f < begin + count; f++ ) {
         face_t &face = faces[f];
-        glBegin( gl_primitive_mode );
-        for ( std::size_t v = 0; v < face.count; v++ ) {
-            int vi = face.idx_begin + v;
-            int i;
-            if ( is_flat ) {
-                if ( v == 0 ) {
-                    glNormal3dv( face.normal.data() );
+        if ( is_flat )
+            glNormal3dv( face.normal.data() );
+        for ( std::size_t t = 1; t + 1 < face.count; t++ ) {
+            const std::size_t corners[3] = { 0, t, t + 1 };
+            for ( std::size_t v : corners ) {
+                int vi = face.idx_begin + v;
+                int i;
+                if ( !is_flat && ( i = normal_indices[vi] ) >= 0 ) {
+                    glNormal3dv( normals[i].data() );
+                }
+                if ( ( i = texcoord_indices[vi] ) >= 0 ) {
+                    glTexCoord2dv( texcoords[i].data() );
                 }
-            } else if ( ( i = normal_indices[vi] ) >= 0 ) {
-                glNormal3dv( normals[i].data() );
+                if ( ( i = vertex_indices[vi] ) >= 0 ) {
+                    glVertex3dv( vertices[i].data() );
+                }
+            }
+        }
+    }
+    glEnd();
+}
+
+
+//------------------------------------------------------------------------------
+// Build smooth per-vertex normals. Every corner (face, vertex) pair gathers the
+// weighted normals of the faces around its vertex, so each output is written by
+// exactly one thread and no atomics or locks are needed.
+void wavefront_obj_t::compute_smooth_normals( double crease_angle, normal_weight_t weight ) {
+    const std::size_t vertex_count = vertices.size();
+    const std::size_t corner_count = vertex_indices.size();
+
+    // faces with a bad vertex index are left without normals
+    std::vector<char> face_valid( faces.size(), 1 );
+    std::vector<std::size_t> corner_face( corner_count );
+    for ( std::size_t f = 0; f < faces.size(); ++f ) {
+        for ( std::size_t c = faces[f].idx_begin; c < faces[f].idx_begin + faces[f].count; ++c ) {
+            corner_face[c] = f;
+            if ( vertex_indices[c] < 0 || std::size_t( vertex_indices[c] ) >= vertex_count )
+                face_valid[f] = 0;
+        }
+    }
+
+    // vertex-to-corner adjacency in compressed rows: the corners of vertex v
+    // are adjacency[adjacency_begin[v]] .. adjacency[adjacency_begin[v + 1] - 1]
+    std::vector<std::size_t> adjacency_begin( vertex_count + 1, 0 );
+    for ( std::size_t c = 0; c < corner_count; ++c ) {
+        if ( face_valid[corner_face[c]] )
+            ++adjacency_begin[vertex_indices[c] + 1];
+    }
+    for ( std::size_t v = 0; v < vertex_count; ++v )
+        adjacency_begin[v + 1] += adjacency_begin[v];
+
+    std::vector<std::size_t> adjacency( adjacency_begin[vertex_count] );
+    std::vector<std::size_t> cursor( adjacency_begin.begin(), adjacency_begin.end() - 1 );
+    for ( std::size_t c = 0; c < corner_count; ++c ) {
+        if ( face_valid[corner_face[c]] )
+            adjacency[cursor[vertex_indices[c]]++] = c;
+    }
+
+    // unit normal of each face and the weight of each of its corners
+    std::vector<double3> face_normals( faces.size(), double3{ 0, 0, 0 } );
+    std::vector<double> corner_weights( corner_count, 0 );
+    parallel_for( 0, faces.size(), [&]( std::size_t f ) {
+        const face_t &face = faces[f];
+        if ( !face_valid[f] || face.count < 3 )
+            return;
+
+        const int *idx = &vertex_indices[face.idx_begin];
+        double3 n = compute_newell_normal( vertices, idx, face.count );
+        face_normals[f] = normalize( n );
+        double area = 0.5 * std::sqrt( dot( n, n ) );
+
+        for ( std::size_t i = 0; i < face.count; ++i ) {
+            if ( weight == normal_weight_t::area ) {
+                corner_weights[face.idx_begin + i] = area;
+            } else {
+                corner_weights[face.idx_begin + i] = compute_corner_angle(
+                        vertices[idx[( i + face.count - 1 ) % face.count]],
+                        vertices[idx[i]],
+                        vertices[idx[( i + 1 ) % face.count]] );
+            }
+        }
+    } );
+
+    // gather: each corner sums the faces around its vertex that lie within the
+    // crease angle of its own face. corners of a vertex which end up with the
+    // same set of faces share a slot, i.e. one output normal.
+    const bool split = crease_angle < 180.0;
+    const double cos_crease = std::cos( crease_angle * std::acos( -1.0 ) / 180.0 );
+    std::vector<double3> corner_normals( corner_count, double3{ 0, 0, 0 } );
+    std::vector<std::size_t> corner_slots( corner_count, 0 );
+    std::vector<std::size_t> slot_begin( vertex_count + 1, 0 );
+
+    parallel_for( 0, vertex_count, [&]( std::size_t v ) {
+        const std::size_t b = adjacency_begin[v], e = adjacency_begin[v + 1];
+        std::size_t slots = 0;
+
+        for ( std::size_t i = b; i < e; ++i ) {
+            const std::size_t c = adjacency[i];
+            const double3 &own = face_normals[corner_face[c]];
+
+            if ( !split && i > b ) {
+                corner_normals[c] = corner_normals[adjacency[b]];
+                continue;
             }
-            if ( ( i = texcoord_indices[vi] ) >= 0 ) {
-                glTexCoord2dv( texcoords[i].data() );
+
+            double3 n{ 0, 0, 0 };
+            for ( std::size_t j = b; j < e; ++j ) {
+                const std::size_t k = adjacency[j];
+                const double3 &other = face_normals[corner_face[k]];
+                if ( split && dot( own, other ) < cos_crease )
+                    continue;
+                for ( int a = 0; a < 3; ++a )
+                    n[a] += corner_weights[k] * other[a];
             }
-            if ( ( i = vertex_indices[vi] ) >= 0 ) {
-                glVertex3dv( vertices[i].data() );
+            n = normalize( n );
+
+            // sums over the same faces in the same order are bitwise equal
+            std::size_t slot = slots;
+            for ( std::size_t j = b; j < i; ++j ) {
+                if ( corner_normals[adjacency[j]] == n ) {
+                    slot = corner_slots[adjacency[j]];
+                    break;
+                }
             }
+            if ( slot == slots )
+                ++slots;
+
+            corner_normals[c] = n;
+            corner_slots[c] = slot;
         }
-        glEnd();
-    }
+        slot_begin[v + 1] = ( e > b ) ? slots : 0;
+    } );
+
+    for ( std::size_t v = 0; v < vertex_count; ++v )
+        slot_begin[v + 1] += slot_begin[v];
+
+    normals.assign( slot_begin[vertex_count], double3{ 0, 0, 0 } );
+    normal_indices.assign( corner_count, -1 );
+    parallel_for( 0, vertex_count, [&]( std::size_t v ) {
+        for ( std::size_t i = adjacency_begin[v]; i < adjacency_begin[v + 1]; ++i ) {
+            const std::size_t c = adjacency[i];
+            const std::size_t n = slot_begin[v] + corner_slots[c];
+            normals[n] = corner_normals[c];
+            normal_indices[c] = int( n );
+        }
+    } );
+
+    is_flat = false;
 }
@@ -4,11 +4,14 @@
 #include <vector>
 #include <array>
 #include <utility>
+#include <string>
+#include <map>
+#include <iosfwd>
 #include <GL/GL.h>
 
 class wavefront_obj_t {
 public:
-	static constexpr GLuint gl_primitive_mode = GL_POLYGON;
+	enum class normal_weight_t { area, angle };
 
 	using double2 = std::array<double, 2>;
 	using double3 = std::array<double, 3>;
@@ -16,6 +19,30 @@ public:
 		std::size_t idx_begin;
 		std::size_t count;
 		double3 normal;
+		int material; // index into materials, or -1 to keep the current GL material
+	};
+	struct material_t {
+		std::string name;
+		std::array<float, 4> ambient{ { 0.2f, 0.2f, 0.2f, 1.0f } };  // Ka (alpha from d)
+		std::array<float, 4> diffuse{ { 0.8f, 0.8f, 0.8f, 1.0f } };  // Kd
+		std::array<float, 4> specular{ { 0.0f, 0.0f, 0.0f, 1.0f } }; // Ks
+		float shininess = 0;                                         // Ns, clamped to GL's 0..128
+		std::string diffuse_map;                                     // map_Kd, relative to the .mtl file
+	};
+	struct batch_t {
+		int material;
+		std::size_t face_begin;
+		std::size_t face_count;
+	};
+	// What the loading constructor spent its time on, in milliseconds.
+	struct load_stats_t {
+		double io_ms = 0;       // reading the file into memory
+		double tokenize_ms = 0; // parsing lines into vertices and index lists
+		double faces_ms = 0;    // face normals and material batches
+		double normals_ms = 0;  // normalizing vn
+		double bounds_ms = 0;   // aabb
+		std::size_t lines = 0;
+		std::map<std::string, std::size_t> skipped; // unsupported directive -> number of lines
 	};
 	std::vector<double3> vertices; // x, y, z
 	std::vector<double3> normals; // x, y, z // unit vector or {0, 0, 0}
@@ -24,12 +51,44 @@ public:
 	std::vector<int> vertex_indices;
 	std::vector<int> normal_indices;
 	std::vector<int> texcoord_indices;
+	std::vector<material_t> materials;
+	std::vector<std::string> material_libraries; // paths of the mtllib files read, in order
+	std::vector<batch_t> batches; // runs of faces sharing a material, see sort_faces_by_material()
 
 	bool is_flat;
 	std::pair<double3, double3> aabb; // bounding box
+	load_stats_t stats;
 
+	wavefront_obj_t() : is_flat( true ) {} // empty mesh, filled in by mesh processing code
 	wavefront_obj_t(const char *path); // constructor: load from file
 	void draw();
+
+	// Print one summary of the load: array sizes, phase times and the
+	// directives that were skipped.
+	void print_load_stats( std::ostream &out, const char *name ) const;
+
+	// Approximate heap footprint in bytes, for cache budgets.
+	std::size_t memory_size() const;
+
+	// Parse a Wavefront .mtl file and append its materials.
+	void load_materials( const std::string &path );
+
+	// Stable-sort faces by material and rebuild batches, so draw() changes
+	// material state once per material rather than once per face.
+	void sort_faces_by_material();
+
+	// Recompute aabb from the current vertices.
+	void compute_bounds();
+
+	// Recompute the normal of every face from its first three vertices.
+	void compute_face_normals();
+
+	// Replace the normals with per-vertex normals averaged over adjacent faces.
+	// Faces meeting at more than crease_angle degrees keep separate normals.
+	void compute_smooth_normals( double crease_angle = 180.0, normal_weight_t weight = normal_weight_t::angle );
+
+private:
+	void draw_faces( std::size_t begin, std::size_t count );
 };
 
 
@@ -1,8 +1,10 @@
+#include <iostream>
 #include <GL/glut.h>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/constants.hpp>
 #include "MyGL.h"
 #include "wavefront_obj.h"
+#include "asset_cache.h"
 
 //------------------------
 // function declarations
@@ -41,7 +43,8 @@ bool optBackFaceCulling = false;
 
 const char *textureFile = "bricks.ppm";
 const char *objFile = "sphere.obj";
-wavefront_obj_t *model = NULL;
+asset_cache_t<wavefront_obj_t> assets;
+asset_cache_t<wavefront_obj_t>::handle_t model;
 
 //------------------------------------------------------------------------------
 int main( int argc, char *argv[] ) {
@@ -53,6 +56,7 @@ int main( int argc, char *argv[] ) {
     glutKeyboardFunc( keyboard );
     glutSpecialFunc( special );
 
+    assets.load_async( objFile );   // read the model while init() loads the texture
     init();
 
     glutMainLoop();
@@ -88,7 +92,8 @@ void init() {
     }
 
     // load the wavefront model
-    model = new wavefront_obj_t( objFile );
+    model = assets.load( objFile );
+    model->print_load_stats( std::cout, objFile );
 
     // make sure GL calls get routed to my subclass of GLRenderer
     GLRenderer::SetGlobalInstance( &myGL );
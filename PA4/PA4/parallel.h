@@ -0,0 +1,119 @@
+#ifndef _PARALLEL_H_
+#define _PARALLEL_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <algorithm>
+#include <cstddef>
+
+// Split [begin, end) into one contiguous chunk per hardware thread and call
+// fn( i ) for every index. The calling thread processes the last chunk itself.
+// fn must only write to data owned by index i (gather, never scatter).
+template<class Fn>
+void parallel_for( std::size_t begin, std::size_t end, Fn fn, std::size_t min_chunk = 1024 ) {
+    if ( end <= begin )
+        return;
+
+    std::size_t count = end - begin;
+    std::size_t workers = std::max( 1u, std::thread::hardware_concurrency() );
+    workers = std::min( workers, ( count + min_chunk - 1 ) / min_chunk );
+    if ( workers <= 1 ) {
+        for ( std::size_t i = begin; i < end; ++i )
+            fn( i );
+        return;
+    }
+
+    std::size_t chunk = ( count + workers - 1 ) / workers;
+    std::vector<std::thread> threads;
+    threads.reserve( workers - 1 );
+    for ( std::size_t w = 0; w + 1 < workers; ++w ) {
+        std::size_t b = begin + w * chunk;
+        std::size_t e = std::min( end, b + chunk );
+        threads.emplace_back( [b, e, &fn]() {
+            for ( std::size_t i = b; i < e; ++i )
+                fn( i );
+        } );
+    }
+    for ( std::size_t i = begin + ( workers - 1 ) * chunk; i < end; ++i )
+        fn( i );
+
+    for ( auto &t : threads )
+        t.join();
+}
+
+// Fixed set of worker threads running queued jobs in FIFO order. The
+// destructor finishes every job already queued before joining the workers.
+class thread_pool_t {
+public:
+    explicit thread_pool_t( std::size_t threads = std::max( 1u, std::thread::hardware_concurrency() ) ) {
+        for ( std::size_t i = 0; i < std::max<std::size_t>( 1, threads ); ++i )
+            workers.emplace_back( [this]() { run(); } );
+    }
+
+    ~thread_pool_t() {
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            stopping = true;
+        }
+        wake.notify_all();
+        for ( auto &t : workers )
+            t.join();
+    }
+
+    thread_pool_t( const thread_pool_t & ) = delete;
+    thread_pool_t &operator=( const thread_pool_t & ) = delete;
+
+    // What fn() returns. std::invoke_result_t needs C++17, which the projects
+    // do not require yet, and std::result_of is gone from C++20.
+#ifdef __cpp_lib_is_invocable
+    template<class Fn>
+    using result_t = std::invoke_result_t<Fn>;
+#else
+    template<class Fn>
+    using result_t = decltype( std::declval<Fn &>()() );
+#endif
+
+    // Queue fn() and return a future for its result (or exception).
+    template<class Fn>
+    std::future<result_t<Fn>> submit( Fn fn ) {
+        auto task = std::make_shared<std::packaged_task<result_t<Fn>()>>( std::move( fn ) );
+        auto result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            jobs.emplace_back( [task]() { ( *task )(); } );
+        }
+        wake.notify_one();
+        return result;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void run() {
+        for ( ;; ) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                wake.wait( lock, [this]() { return stopping || !jobs.empty(); } );
+                if ( jobs.empty() )
+                    return;
+                job = std::move( jobs.front() );
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+};
+
+#endif // _PARALLEL_H_
@@ -8,10 +8,12 @@
 #include <cmath>
 #include <cstring>
 #include <stdexcept>
+#include <cstdlib>
 #include <GL/glut.h>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "GLRenderer.h"
+#include "stopwatch.hpp"
 
 namespace {
 
@@ -21,6 +23,88 @@ glm::dvec3 compute_face_normal( glm::dvec3 &v0, glm::dvec3 &v1, glm::dvec3 &v2 )
     return glm::normalize( n );
 }
 
+//Milliseconds on watch, which keeps running from zero again.
+double lap( Stopwatch &watch ) {
+    double ms = 1000.0 * watch.GetTime();
+    watch.Reset();
+    return ms;
+}
+
+//Cursor over one line of an OBJ file. Every read stops at the end of the
+//line, so a line with missing values never consumes the next one.
+struct line_t {
+    const char *p, *end;
+
+    void skip_blanks() {
+        while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\r' ) )
+            ++p;
+    }
+
+    bool word( std::string &w ) {
+        skip_blanks();
+        const char *begin = p;
+        while ( p < end && *p != ' ' && *p != '\t' && *p != '\r' )
+            ++p;
+        w.assign( begin, p );
+        return p != begin;
+    }
+
+    bool number( double &x ) {
+        skip_blanks();
+        if ( p == end )
+            return false;
+        char *next;
+        x = std::strtod( p, &next );
+        if ( next == p || next > end )
+            return false;
+        p = next;
+        return true;
+    }
+
+    bool index( long &i ) {
+        if ( p == end || !( *p == '-' || *p == '+' || ( *p >= '0' && *p <= '9' ) ) )
+            return false;
+        char *next;
+        i = std::strtol( p, &next, 10 );
+        p = next;
+        return true;
+    }
+
+    // One v, v/t, v//n or v/t/n item of an f line; missing indices are 0.
+    bool corner( long &v, long &t, long &n ) {
+        skip_blanks();
+        v = t = n = 0;
+        if ( !index( v ) )
+            return false;
+        if ( p < end && *p == '/' ) {
+            ++p;
+            index( t );
+            if ( p < end && *p == '/' ) {
+                ++p;
+                index( n );
+            }
+        }
+        // skip whatever is left of a malformed item
+        while ( p < end && *p != ' ' && *p != '\t' && *p != '\r' )
+            ++p;
+        return true;
+    }
+};
+
+//Index of the material called name. An unknown name is -1, or a new material
+//with default colors if create is set.
+int find_material( std::vector<wavefront_obj_t::material_t> &materials, const std::string &name, bool create ) {
+    for ( std::size_t i = 0; i < materials.size(); ++i ) {
+        if ( materials[i].name == name )
+            return int( i );
+    }
+    if ( !create )
+        return -1;
+    materials.push_back( wavefront_obj_t::material_t() );
+    materials.back().name = name;
+    return int( materials.size() - 1 );
+}
+
 //Given a list (represented by a pair of iterators) of vertices, compute axis-aligned bounding box (AABB).
 template<class IterT>
 std::pair<glm::dvec3, glm::dvec3> compute_aabb( IterT vert_begin, IterT vert_end ) {
@@ -43,112 +127,228 @@ std::pair<glm::dvec3, glm::dvec3> compute_aabb( IterT vert_begin, IterT vert_end
 wavefront_obj_t::wavefront_obj_t( const std::string &path ) {
     is_flat = true;
 
-    std::string line;
-    std::istringstream line_stream, item_stream;
-
-    std::ifstream file( path );
+    Stopwatch watch;
+    watch.Start();
+    std::ifstream file( path, std::ios::binary | std::ios::ate );
     if ( !file )
         throw std::runtime_error( "Cannot open file." );
+    std::string text( std::size_t( file.tellg() ), '\0' );
+    file.seekg( 0 );
+    if ( !file.read( &text[0], text.size() ) )
+        throw std::runtime_error( "Cannot read file." );
+    stats.io_ms = lap( watch );
 
-    while ( std::getline( file, line ) ) {
-        // strip off comments and blank lines
-        if ( line[0] == '#' || line.size() == 0 )
-            continue;
+    // mtllib and map_Kd paths are relative to the directory of the OBJ file
+    std::size_t slash = path.find_last_of( "/\\" );
+    std::string directory = ( slash == std::string::npos ) ? std::string() : path.substr( 0, slash + 1 );
+    int material = -1;
 
-        // parse line
-        line_stream.clear();
-        line_stream.str( line );
+    const char *p = text.c_str(), *end = p + text.size();
+    while ( p < end ) {
+        const char *eol = static_cast<const char *>( std::memchr( p, '\n', end - p ) );
+        line_t line{ p, eol ? eol : end };
+        p = eol ? eol + 1 : end;
+        ++stats.lines;
 
+        // strip off comments and blank lines
         std::string mode;
-        line_stream >> mode;
+        if ( !line.word( mode ) || mode[0] == '#' )
+            continue;
+
         if ( mode == "v" ) {
-            double x, y, z;
-            line_stream >> x >> y >> z;
-            vertices.push_back( glm::dvec3{ x, y, z } );
+            glm::dvec3 v{ 0, 0, 0 };
+            line.number( v[0] ), line.number( v[1] ), line.number( v[2] );
+            vertices.push_back( v );
         } else if ( mode == "vn" ) {
-            double x, y, z;
-            line_stream >> x >> y >> z;
-            normals.push_back( glm::normalize( glm::dvec3{ x, y, z } ) );
+            glm::dvec3 n{ 0, 0, 0 };
+            line.number( n[0] ), line.number( n[1] ), line.number( n[2] );
+            normals.push_back( n );
         } else if ( mode == "vt" ) {
-            double u, v;
-            line_stream >> u >> v;
-            texcoords.push_back( glm::dvec2{u, v} );
+            glm::dvec2 t{ 0, 0 };
+            line.number( t[0] ), line.number( t[1] );
+            texcoords.push_back( t );
         } else if ( mode == "f" ) {
             face_t face;
             std::memset( &face, 0, sizeof( face_t ) );
             face.idx_begin = vertex_indices.size();
+            face.material = material;
 
-            std::string item;
-            while ( line_stream >> item ) {
-                item_stream.clear();
-                item_stream.str( item );
-
-                int v = 0, t = 0, n = 0;
-                do {
-                    item_stream >> v;
-                    char c;
-                    if ( !( bool( item_stream >> c ) && c == '/' ) )
-                        continue;
-                    if ( !( item_stream >> t ) )
-                        item_stream.clear();
-                    if ( !( bool( item_stream >> c ) && c == '/' ) )
-                        continue;
-                    if ( !( item_stream >> n ) )
-                        item_stream.clear();
-                } while ( false );
-
-                vertex_indices.push_back( v - 1 );
-                texcoord_indices.push_back( t - 1 );
-                normal_indices.push_back( n - 1 );
+            long v, t, n;
+            while ( line.corner( v, t, n ) ) {
+                // negative indices count back from the latest element
+                vertex_indices.push_back( int( v < 0 ? long( vertices.size() ) + v : v - 1 ) );
+                texcoord_indices.push_back( int( t < 0 ? long( texcoords.size() ) + t : t - 1 ) );
+                normal_indices.push_back( int( n < 0 ? long( normals.size() ) + n : n - 1 ) );
                 ++face.count;
 
                 if ( n )
                     is_flat = false;
             }
-            if ( face.count > 2 ) {
-                face.normal = compute_face_normal(
-                                  vertices[vertex_indices[face.idx_begin]],
-                                  vertices[vertex_indices[face.idx_begin + 1]],
-                                  vertices[vertex_indices[face.idx_begin + 2]]
-                              );
-            }
-
             faces.push_back( face );
         } else if ( mode == "g" ) { // group
         } else if ( mode == "s" ) { // smoothing group
-        } else if ( mode == "u" ) { // material line
+        } else if ( mode == "mtllib" ) { // material library
+            std::string name;
+            while ( line.word( name ) )
+                load_materials( directory + name );
+        } else if ( mode == "usemtl" ) { // material line
+            std::string name;
+            line.word( name );
+            material = find_material( materials, name, false );
         } else {
-            std::cerr << "Warning: unsupported Wavefront OBJ option: " << mode << "\n";
+            ++stats.skipped[mode];
+        }
+    }
+    stats.tokenize_ms = lap( watch );
+
+    for ( auto &face : faces ) {
+        if ( face.count > 2 ) {
+            face.normal = compute_face_normal(
+                              vertices[vertex_indices[face.idx_begin]],
+                              vertices[vertex_indices[face.idx_begin + 1]],
+                              vertices[vertex_indices[face.idx_begin + 2]]
+                          );
         }
     }
+    sort_faces_by_material();
+    stats.faces_ms = lap( watch );
+
+    for ( auto &n : normals )
+        n = glm::normalize( n );
+    stats.normals_ms = lap( watch );
 
     aabb = compute_aabb( std::begin( vertices ), std::end( vertices ) );
+    stats.bounds_ms = lap( watch );
+}
+
+void wavefront_obj_t::print_load_stats( std::ostream &out, const char *name ) const {
+    out << name << ": " << stats.lines << " lines, " << vertices.size() << " vertices, "
+        << normals.size() << " normals, " << texcoords.size() << " texcoords, "
+        << faces.size() << " faces, " << vertex_indices.size() << " corners, "
+        << materials.size() << " materials\n";
+    out << "  io " << stats.io_ms << " ms, tokenize " << stats.tokenize_ms << " ms, faces "
+        << stats.faces_ms << " ms, normals " << stats.normals_ms << " ms, aabb " << stats.bounds_ms << " ms\n";
+    if ( !stats.skipped.empty() ) {
+        out << "  skipped unsupported lines:";
+        for ( auto &skipped : stats.skipped )
+            out << " " << skipped.first << " x" << skipped.second;
+        out << "\n";
+    }
+}
+
+//------------------------------------------------------------------------------
+// Read newmtl blocks from a .mtl file. A missing library is only a warning:
+// faces that use its materials keep whatever GL material is current.
+void wavefront_obj_t::load_materials( const std::string &path ) {
+    std::ifstream file( path );
+    if ( !file ) {
+        std::cerr << "Warning: cannot open material library " << path << "\n";
+        return;
+    }
+
+    std::string line, key;
+    std::istringstream line_stream;
+    material_t *m = nullptr;
+    while ( std::getline( file, line ) ) {
+        line_stream.clear();
+        line_stream.str( line );
+        if ( !( line_stream >> key ) || key[0] == '#' )
+            continue;
+
+        if ( key == "newmtl" ) {
+            std::string name;
+            line_stream >> name;
+            m = &materials[find_material( materials, name, true )];
+        } else if ( !m ) {
+            continue;
+        } else if ( key == "Ka" ) {
+            line_stream >> m->ambient.r >> m->ambient.g >> m->ambient.b;
+        } else if ( key == "Kd" ) {
+            line_stream >> m->diffuse.r >> m->diffuse.g >> m->diffuse.b;
+        } else if ( key == "Ks" ) {
+            line_stream >> m->specular.r >> m->specular.g >> m->specular.b;
+        } else if ( key == "Ns" ) {
+            line_stream >> m->shininess;
+            m->shininess = glm::clamp( m->shininess, 0.0f, 128.0f );
+        } else if ( key == "d" || key == "Tr" ) {
+            float alpha = 1;
+            line_stream >> alpha;
+            if ( key == "Tr" )
+                alpha = 1 - alpha;
+            m->ambient.a = m->diffuse.a = m->specular.a = alpha;
+        } else if ( key == "map_Kd" ) {
+            line_stream >> m->diffuse_map;
+        }
+    }
+}
+
+std::size_t wavefront_obj_t::memory_size() const {
+    std::size_t bytes = sizeof( *this );
+    bytes += vertices.capacity() * sizeof( vertices[0] ) + normals.capacity() * sizeof( normals[0] );
+    bytes += texcoords.capacity() * sizeof( texcoords[0] ) + faces.capacity() * sizeof( faces[0] );
+    bytes += ( vertex_indices.capacity() + normal_indices.capacity() + texcoord_indices.capacity() ) * sizeof( int );
+    bytes += materials.capacity() * sizeof( material_t ) + batches.capacity() * sizeof( batch_t );
+    return bytes;
+}
+
+void wavefront_obj_t::sort_faces_by_material() {
+    std::stable_sort( faces.begin(), faces.end(), []( const face_t &a, const face_t &b ) {
+        return a.material < b.material;
+    } );
+
+    batches.clear();
+    for ( std::size_t f = 0; f < faces.size(); ++f ) {
+        if ( batches.empty() || batches.back().material != faces[f].material )
+            batches.push_back( batch_t{ faces[f].material, f, 0 } );
+        ++batches.back().face_count;
+    }
 }
 
 
 //------------------------------------------------------------------------------
 // Draw object using GL calls
 void wavefront_obj_t::draw() {
-    for ( std::size_t f = 0; f < faces.size(); f++ ) {
+    if ( batches.empty() ) {
+        draw_faces( 0, faces.size() );
+        return;
+    }
+    for ( auto &batch : batches ) {
+        if ( batch.material >= 0 ) {
+            const material_t &m = materials[batch.material];
+            glMaterialfv( GL_FRONT_AND_BACK, GL_AMBIENT, glm::value_ptr( m.ambient ) );
+            glMaterialfv( GL_FRONT_AND_BACK, GL_DIFFUSE, glm::value_ptr( m.diffuse ) );
+            glMaterialfv( GL_FRONT_AND_BACK, GL_SPECULAR, glm::value_ptr( m.specular ) );
+            glMaterialf( GL_FRONT_AND_BACK, GL_SHININESS, m.shininess );
+        }
+        draw_faces( batch.face_begin, batch.face_count );
+    }
+}
+
+// All faces of a run go into one GL_TRIANGLES block, each polygon as a fan.
+// Every Begin() of the software renderer snapshots the GL state, so this is
+// much cheaper than a glBegin/glEnd pair per face.
+void wavefront_obj_t::draw_faces( std::size_t begin, std::size_t count ) {
+    glBegin( GL_TRIANGLES );
+    for ( std::size_t f = begin; f < begin + count; f++ ) {
         face_t &face = faces[f];
-        glBegin( gl_primitive_mode );
-        for ( std::size_t v = 0; v < face.count; v++ ) {
-            int vi = face.idx_begin + v;
-            int i;
-            if ( is_flat ) {
-                if ( v == 0 ) {
-                    glNormal3dv( glm::value_ptr( face.normal ) );
+        if ( is_flat )
+            glNormal3dv( glm::value_ptr( face.normal ) );
+        for ( std::size_t t = 1; t + 1 < face.count; t++ ) {
+            const std::size_t corners[3] = { 0, t, t + 1 };
+            for ( std::size_t v : corners ) {
+                int vi = face.idx_begin + v;
+                int i;
+                if ( !is_flat && ( i = normal_indices[vi] ) >= 0 ) {
+                    glNormal3dv( glm::value_ptr( normals[i] ) );
+                }
+                if ( ( i = texcoord_indices[vi] ) >= 0 ) {
+                    glTexCoord2dv( glm::value_ptr( texcoords[i] ) );
+                }
+                if ( ( i = vertex_indices[vi] ) >= 0 ) {
+                    glVertex3dv( glm::value_ptr( vertices[i] ) );
                 }
-            } else if ( ( i = normal_indices[vi] ) >= 0 ) {
-                glNormal3dv( glm::value_ptr( normals[i] ) );
-            }
-            if ( ( i = texcoord_indices[vi] ) >= 0 ) {
-                glTexCoord2dv( glm::value_ptr( texcoords[i] ) );
-            }
-            if ( ( i = vertex_indices[vi] ) >= 0 ) {
-                glVertex3dv( glm::value_ptr( vertices[i] ) );
             }
         }
-        glEnd();
     }
+    glEnd();
 }
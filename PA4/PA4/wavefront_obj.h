@@ -4,17 +4,41 @@
 #include <vector>
 #include <string>
 #include <utility>
+#include <map>
+#include <iosfwd>
 #include <GL/glut.h>
 #include <glm/glm.hpp>
 
 class wavefront_obj_t  {
   public:
-    static constexpr GLuint gl_primitive_mode = GL_POLYGON;
-
     struct face_t {
         std::size_t idx_begin;
         std::size_t count;
         glm::dvec3 normal;
+        int material; // index into materials, or -1 to keep the current GL material
+    };
+    struct material_t {
+        std::string name;
+        glm::vec4 ambient{ 0.2f, 0.2f, 0.2f, 1.0f };  // Ka (alpha from d)
+        glm::vec4 diffuse{ 0.8f, 0.8f, 0.8f, 1.0f };  // Kd
+        glm::vec4 specular{ 0.0f, 0.0f, 0.0f, 1.0f }; // Ks
+        float shininess = 0;                          // Ns, clamped to GL's 0..128
+        std::string diffuse_map;                      // map_Kd, relative to the .mtl file
+    };
+    struct batch_t {
+        int material;
+        std::size_t face_begin;
+        std::size_t face_count;
+    };
+    // What the loading constructor spent its time on, in milliseconds.
+    struct load_stats_t {
+        double io_ms = 0;       // reading the file into memory
+        double tokenize_ms = 0; // parsing lines into vertices and index lists
+        double faces_ms = 0;    // face normals and material batches
+        double normals_ms = 0;  // normalizing vn
+        double bounds_ms = 0;   // aabb
+        std::size_t lines = 0;
+        std::map<std::string, std::size_t> skipped; // unsupported directive -> number of lines
     };
     std::vector<glm::dvec3> vertices;	// x, y, z
     std::vector<glm::dvec3> normals;	// x, y, z: unit vector or {0, 0, 0}
@@ -23,12 +47,32 @@ class wavefront_obj_t  {
     std::vector<int> vertex_indices;
     std::vector<int> normal_indices;
     std::vector<int> texcoord_indices;
+    std::vector<material_t> materials;
+    std::vector<batch_t> batches; // runs of faces sharing a material, see sort_faces_by_material()
 
     bool is_flat;
     std::pair<glm::dvec3, glm::dvec3> aabb; // bounding box
+    load_stats_t stats;
 
     wavefront_obj_t( const std::string &path ); // constructor: load from the file
     void draw();
+
+    // Print one summary of the load: array sizes, phase times and the
+    // directives that were skipped.
+    void print_load_stats( std::ostream &out, const char *name ) const;
+
+    // Approximate heap footprint in bytes, for cache budgets.
+    std::size_t memory_size() const;
+
+    // Parse a Wavefront .mtl file and append its materials.
+    void load_materials( const std::string &path );
+
+    // Stable-sort faces by material and rebuild batches, so draw() changes
+    // material state once per material rather than once per face.
+    void sort_faces_by_material();
+
+  private:
+    void draw_faces( std::size_t begin, std::size_t count );
 };
 
 